@@ -0,0 +1,557 @@
+/*	Benchmarks
+	Console app which times Im3d's CPU side (recording, EndFrame(), MergeContexts()), no graphics API is required.
+	Run all benchmarks, or pass the names of the ones to run:
+
+		im3d_benchmark merge_text
+
+	Build via premake5.lua or directly, e.g.:
+
+		g++ -std=c++11 -O2 -pthread -I../.. im3d_benchmark.cpp ../../im3d.cpp -o im3d_benchmark
+
+	Config options (IM3D_SIMD, IM3D_INDEXED_DRAW_LISTS, etc.) can be passed via -D to compare builds.
+
+	Timings are the best of several frames to reduce noise; compare results from the same machine/build only.
+*/
+#include "im3d.h"
+#include "im3d_math.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace Im3d;
+
+namespace {
+
+double TimeMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+// Set a context for the lifetime of the object, restore the previous one after.
+struct ScopedContext
+{
+	Context* m_prev;
+	ScopedContext(Context& _ctx): m_prev(&GetContext()) { SetContext(_ctx); }
+	~ScopedContext()                                     { SetContext(*m_prev); }
+};
+
+// Record _vertexCount triangle vertices per frame via Vertex() or Vertices(), under _matrix. Return the best rate in
+// millions of vertices per second, EndFrame() isn't timed.
+double RecordVertices(const Mat4& _matrix, bool _bulk, U32 _vertexCount)
+{
+	Context ctx;
+	ScopedContext scope(ctx);
+	std::vector<Vec3> positions;
+	for (U32 i = 0; i < _vertexCount; ++i)
+	{
+		positions.push_back(Vec3((float)(i % 97), (float)(i % 89), (float)(i % 83)));
+	}
+	double best = 1e9;
+	for (int frame = 0; frame < 20; ++frame)
+	{
+		NewFrame();
+		PushMatrix(_matrix);
+		double t = TimeMs();
+		BeginTriangles();
+		if (_bulk)
+		{
+			Vertices(positions.data(), _vertexCount);
+		}
+		else
+		{
+			for (U32 i = 0; i < _vertexCount; ++i)
+			{
+				Vertex(positions[i]);
+			}
+		}
+		End();
+		t = TimeMs() - t;
+		best = t < best ? t : best;
+		PopMatrix();
+		EndFrame();
+	}
+	return (double)_vertexCount / (best * 1000.0);
+}
+
+void Benchmark_Transform()
+{
+	#if defined(IM3D_SIMD) && IM3D_SIMD
+		printf("  IM3D_SIMD enabled\n");
+	#else
+		printf("  IM3D_SIMD disabled (build with -DIM3D_SIMD=1 to compare)\n");
+	#endif
+	const U32 vertexCount = 32 * 1024 - 2; // ~32k, multiple of 3
+	const Mat4 identity(1.0f);
+	const Mat4 transform(Vec3(1.0f, 2.0f, 3.0f), Rotation(Normalize(Vec3(1.0f, 1.0f, 0.0f)), 0.7f), Vec3(2.0f, 0.5f, 1.5f));
+	printf("  %u vertices, identity:  Vertex() %7.1f Mverts/s, Vertices() %7.1f Mverts/s\n", vertexCount, RecordVertices(identity, false, vertexCount), RecordVertices(identity, true, vertexCount));
+	printf("  %u vertices, transform: Vertex() %7.1f Mverts/s, Vertices() %7.1f Mverts/s\n", vertexCount, RecordVertices(transform, false, vertexCount), RecordVertices(transform, true, vertexCount));
+}
+
+// Pseudo-random float in [0, 1), deterministic across runs.
+float Random(U32& _seed_)
+{
+	_seed_ = _seed_ * 1664525u + 1013904223u;
+	return (float)(_seed_ >> 8) / (float)(1u << 24);
+}
+
+Vec3 RandomPosition(U32& _seed_)
+{
+	return Vec3(Random(_seed_), Random(_seed_), Random(_seed_)) * 200.0f - Vec3(100.0f);
+}
+
+inline Vec3 GetPosition(const VertexData& _v)        { return Vec3(_v.m_positionSize); }
+inline Vec3 GetPosition(const VertexDataCompact& _v) { return _v.m_position; }
+
+// Sort key of the primitive at _vertices, as computed by Context::sort() (mean squared distance to the view origin).
+template <typename T>
+float GetSortKey(const T* _vertices, const U32* _indices, U32 _start, U32 _vertsPerPrim, const Vec3& _viewOrigin)
+{
+	float key = 0.0f;
+	for (U32 i = _start; i < _start + _vertsPerPrim; ++i)
+	{
+		key += Length2(GetPosition(_vertices[_indices ? _indices[i] : i]) - _viewOrigin);
+	}
+	return key / (float)_vertsPerPrim;
+}
+
+struct SortKey
+{
+	float m_key;
+	U32   m_start;
+};
+
+// Back to front, the comparison used with qsort() before Context::sort() used a radix sort.
+int CompareSortKeys(const void* _a, const void* _b)
+{
+	const float a = ((const SortKey*)_a)->m_key;
+	const float b = ((const SortKey*)_b)->m_key;
+	return a < b ? 1 : (a > b ? -1 : 0);
+}
+
+// Reference implementation of the previous sort: compute keys, qsort(), reorder the vertices. Return the sorted keys.
+std::vector<float> QsortReference(std::vector<VertexData>& _vertices_, U32 _vertsPerPrim, const Vec3& _viewOrigin)
+{
+	std::vector<SortKey> keys;
+	for (U32 i = 0; i < (U32)_vertices_.size(); i += _vertsPerPrim)
+	{
+		SortKey key = { GetSortKey(_vertices_.data(), nullptr, i, _vertsPerPrim, _viewOrigin), i };
+		keys.push_back(key);
+	}
+	qsort(keys.data(), keys.size(), sizeof(SortKey), CompareSortKeys);
+	std::vector<VertexData> sorted;
+	sorted.reserve(_vertices_.size());
+	std::vector<float> ret;
+	for (const SortKey& key : keys)
+	{
+		sorted.insert(sorted.end(), _vertices_.begin() + key.m_start, _vertices_.begin() + key.m_start + _vertsPerPrim);
+		ret.push_back(key.m_key);
+	}
+	_vertices_.swap(sorted);
+	return ret;
+}
+
+// EndFrame() with _triangleCount sorted triangles and _lineCount sorted lines at random positions, vs. the qsort()
+// reference on the same data. Also check that the draw lists are in the same (back to front) order as the reference.
+void SortPrimitives(U32 _triangleCount, U32 _lineCount)
+{
+	Context ctx;
+	ScopedContext scope(ctx);
+	const Vec3 viewOrigin(0.0f, 0.0f, 150.0f);
+	std::vector<VertexData> vertices[2]; // triangles, lines
+	U32 seed = 1;
+	for (U32 i = 0; i < _triangleCount * 3; ++i)
+	{
+		vertices[0].push_back(VertexData(RandomPosition(seed), 1.0f, Color((U32)i << 8 | 0xffu)));
+	}
+	for (U32 i = 0; i < _lineCount * 2; ++i)
+	{
+		vertices[1].push_back(VertexData(RandomPosition(seed), 2.0f, Color((U32)i << 8 | 0xffu)));
+	}
+
+	double bestEndFrame = 1e9;
+	for (int frame = 0; frame < 15; ++frame)
+	{
+		GetAppData().m_viewOrigin = viewOrigin;
+		NewFrame();
+		PushEnableSorting(true);
+		BeginTriangles();
+		for (const VertexData& v : vertices[0])
+		{
+			Vertex(Vec3(v.m_positionSize), v.m_positionSize.w, v.m_color);
+		}
+		End();
+		BeginLines();
+		for (const VertexData& v : vertices[1])
+		{
+			Vertex(Vec3(v.m_positionSize), v.m_positionSize.w, v.m_color);
+		}
+		End();
+		PopEnableSorting();
+		double t = TimeMs();
+		EndFrame();
+		t = TimeMs() - t;
+		bestEndFrame = t < bestEndFrame ? t : bestEndFrame;
+	}
+
+ // keys of the sorted draw lists, per primitive type
+	std::vector<float> keys[2];
+	for (U32 i = 0; i < GetDrawListCount(); ++i)
+	{
+		const DrawList& drawList = GetDrawLists()[i];
+		const int list = drawList.m_primType == DrawPrimitive_Triangles ? 0 : 1;
+		const U32 vertsPerPrim = list == 0 ? 3 : 2;
+		const U32 count = drawList.m_indexData ? drawList.m_indexCount : drawList.m_vertexCount;
+		for (U32 j = 0; j < count; j += vertsPerPrim)
+		{
+			keys[list].push_back(GetSortKey(drawList.m_vertexData, drawList.m_indexData, j, vertsPerPrim, viewOrigin));
+		}
+	}
+
+	double bestQsort = 1e9;
+	bool identical = true;
+	for (int frame = 0; frame < 15; ++frame)
+	{
+		std::vector<VertexData> sorted[2] = { vertices[0], vertices[1] };
+		double t = TimeMs();
+		std::vector<float> refKeys[2] = { QsortReference(sorted[0], 3, viewOrigin), QsortReference(sorted[1], 2, viewOrigin) };
+		t = TimeMs() - t;
+		bestQsort = t < bestQsort ? t : bestQsort;
+		identical = identical && refKeys[0] == keys[0] && refKeys[1] == keys[1];
+	}
+	printf("  %7u triangles + %7u lines: EndFrame() %8.3fms, qsort reference %8.3fms, draw list order %s\n", _triangleCount, _lineCount, bestEndFrame, bestQsort, identical ? "identical" : "DIFFERENT");
+}
+
+void Benchmark_Sort()
+{
+	SortPrimitives(20000, 10000);
+	SortPrimitives(200000, 100000);
+}
+
+// Allocator which counts calls, see Context(const Allocator&).
+struct CountingAllocator
+{
+	U32 m_allocCount = 0;
+
+	static void* Allocate(size_t _size, void* _userData) { ++((CountingAllocator*)_userData)->m_allocCount; return malloc(_size); }
+	static void  Free(void* _ptr, void*)                 { free(_ptr); }
+
+	Allocator get()
+	{
+		Allocator ret;
+		ret.m_allocate = &Allocate;
+		ret.m_free     = &Free;
+		ret.m_userData = this;
+		return ret;
+	}
+};
+
+// Create _layerCount layers in a new context (push/pop each layer once) and report the allocations made while creating
+// them, then record the same layers again during a second frame which shouldn't allocate.
+void CreateLayers(U32 _layerCount)
+{
+	double best = 1e9;
+	U32 createAllocCount = 0;
+	U32 steadyAllocCount = 0;
+	for (int run = 0; run < 10; ++run)
+	{
+		CountingAllocator counter;
+		Context ctx(counter.get());
+		ScopedContext scope(ctx);
+		for (int frame = 0; frame < 2; ++frame)
+		{
+			NewFrame();
+			const U32 allocCount = counter.m_allocCount;
+			double t = TimeMs();
+			for (U32 i = 0; i < _layerCount; ++i)
+			{
+				PushLayerId((Id)(i + 1));
+				PopLayerId();
+			}
+			t = TimeMs() - t;
+			if (frame == 0)
+			{
+				best = t < best ? t : best;
+				createAllocCount = counter.m_allocCount - allocCount;
+			}
+			else
+			{
+				steadyAllocCount = counter.m_allocCount - allocCount;
+			}
+			EndFrame();
+		}
+	}
+	printf("  %6u layers: create %7.3fms, %6u allocations; next frame %u allocations\n", _layerCount, best, createAllocCount, steadyAllocCount);
+}
+
+void Benchmark_Layers()
+{
+	CreateLayers(1000);
+	CreateLayers(10000);
+}
+
+// AppData::parallelForCallback implementations. The threaded version spawns threads per call for simplicity, an app
+// would use its job system.
+void ParallelForThreads(U32 _count, void (*_task)(U32 _index, void* _taskData), void* _taskData)
+{
+	std::atomic<U32> next(0);
+	auto worker = [&]()
+		{
+			for (U32 i = next++; i < _count; i = next++)
+			{
+				_task(i, _taskData);
+			}
+		};
+	const U32 threadCount = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0;
+	std::vector<std::thread> threads;
+	for (U32 i = 0; i < threadCount && i + 1 < _count; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+double g_taskMs; // time spent in ParallelForTimed()
+void ParallelForTimed(U32 _count, void (*_task)(U32 _index, void* _taskData), void* _taskData)
+{
+	double t = TimeMs();
+	for (U32 i = 0; i < _count; ++i)
+	{
+		_task(i, _taskData);
+	}
+	g_taskMs += TimeMs() - t;
+}
+
+// Draw lists of the current context, vertices gathered through m_indexData, to compare output between merge modes.
+std::vector<char> GetDrawData()
+{
+	std::vector<char> ret;
+	for (U32 i = 0; i < GetDrawListCount(); ++i)
+	{
+		const DrawList& drawList = GetDrawLists()[i];
+		ret.insert(ret.end(), (const char*)&drawList.m_layerId, (const char*)&drawList.m_layerId + sizeof(Id));
+		ret.insert(ret.end(), (const char*)&drawList.m_primType, (const char*)&drawList.m_primType + sizeof(DrawPrimitiveType));
+		const U32 count = drawList.m_indexData ? drawList.m_indexCount : drawList.m_vertexCount;
+		for (U32 j = 0; j < count; ++j)
+		{
+			const DrawVertexData& v = drawList.m_vertexData[drawList.m_indexData ? drawList.m_indexData[j] : j];
+			ret.insert(ret.end(), (const char*)&v, (const char*)&v + sizeof(DrawVertexData));
+		}
+	}
+	return ret;
+}
+
+// Merge _sourceCount contexts of 4 layers x (50k line + ~50k triangle vertices) into one, via sequential MergeContexts()
+// calls and via one multi-source call (serial, timed copy tasks, threaded). Draw data must be identical in all modes.
+void MergeSources(U32 _sourceCount)
+{
+	enum Mode { Mode_Sequential, Mode_Serial, Mode_Timed, Mode_Threaded, Mode_Count };
+	std::vector<Context> srcs(_sourceCount);
+	std::vector<const Context*> srcPtrs;
+	for (const Context& src : srcs)
+	{
+		srcPtrs.push_back(&src);
+	}
+	Context dst;
+	ScopedContext scope(dst);
+	double best[Mode_Count];
+	double bestTaskMs = 0.0;
+	std::vector<char> drawData[Mode_Count];
+	for (int mode = 0; mode < Mode_Count; ++mode)
+	{
+		best[mode] = 1e9;
+		for (int frame = 0; frame < 8; ++frame)
+		{
+			for (U32 i = 0; i < _sourceCount; ++i)
+			{
+				SetContext(srcs[i]);
+				NewFrame();
+				for (int layer = 0; layer < 4; ++layer)
+				{
+					PushLayerId((Id)(layer + 1));
+					BeginLines();
+					for (int j = 0; j < 50000; ++j)
+					{
+						Vertex(Vec3((float)j, (float)i, 0.0f));
+					}
+					End();
+					BeginTriangles();
+					for (int j = 0; j < 49998; ++j)
+					{
+						Vertex(Vec3((float)j, (float)i, 1.0f));
+					}
+					End();
+					PopLayerId();
+				}
+			}
+
+			SetContext(dst);
+			GetAppData().parallelForCallback = mode == Mode_Threaded ? &ParallelForThreads : (mode == Mode_Timed ? &ParallelForTimed : nullptr);
+			NewFrame();
+			g_taskMs = 0.0;
+			double t = TimeMs();
+			if (mode == Mode_Sequential)
+			{
+				for (const Context& src : srcs)
+				{
+					MergeContexts(dst, src);
+				}
+			}
+			else
+			{
+				MergeContexts(dst, srcPtrs.data(), _sourceCount);
+			}
+			t = TimeMs() - t;
+			if (t < best[mode])
+			{
+				best[mode] = t;
+				bestTaskMs = mode == Mode_Timed ? g_taskMs : bestTaskMs;
+			}
+			EndFrame();
+			if (frame == 0)
+			{
+				drawData[mode] = GetDrawData();
+			}
+
+			for (Context& src : srcs)
+			{
+				SetContext(src);
+				EndFrame();
+			}
+		}
+	}
+	bool identical = true;
+	for (int mode = 1; mode < Mode_Count; ++mode)
+	{
+		identical = identical && drawData[mode] == drawData[0];
+	}
+	printf("  %2u sources: sequential %8.3fms, multi-source serial %8.3fms (copy tasks %8.3fms of %8.3fms), threaded %8.3fms, draw data %s\n",
+		_sourceCount, best[Mode_Sequential], best[Mode_Serial], bestTaskMs, best[Mode_Timed], best[Mode_Threaded], identical ? "identical" : "DIFFERENT"
+		);
+}
+
+void Benchmark_MergeSources()
+{
+	printf("  %u hardware threads\n", std::thread::hardware_concurrency());
+	MergeSources(4);
+	MergeSources(8);
+	MergeSources(16);
+}
+
+// Merge one source context with _layerCount layers of _labelCount 32 byte labels into an empty context. The
+// destination text buffer should grow with the # of labels merged, not with the # of layers x the source buffer size.
+void MergeText(int _layerCount, int _labelCount)
+{
+	Context dst, src;
+	ScopedContext scope(dst);
+	double best = 1e9;
+	U32 textBufferSize = 0;
+	for (int frame = 0; frame < 8; ++frame)
+	{
+		SetContext(src);
+		NewFrame();
+		for (int layer = 0; layer < _layerCount; ++layer)
+		{
+			PushLayerId((Id)(layer + 1));
+			for (int label = 0; label < _labelCount; ++label)
+			{
+				char text[64];
+				snprintf(text, sizeof(text), "label %05d/%05d ------------", layer, label);
+				Text(Vec3(0.0f), 0, text);
+			}
+			PopLayerId();
+		}
+
+		SetContext(dst);
+		NewFrame();
+		double t = TimeMs();
+		MergeContexts(dst, src);
+		t = TimeMs() - t;
+		best = t < best ? t : best;
+		EndFrame();
+
+	 // the text buffer isn't exposed directly, use the end of the last label
+		textBufferSize = 0;
+		for (U32 i = 0; i < GetTextDrawListCount(); ++i)
+		{
+			const TextDrawList& drawList = GetTextDrawLists()[i];
+			for (U32 j = 0; j < drawList.m_textDataCount; ++j)
+			{
+				const TextData& textData = drawList.m_textData[j];
+				const U32 end = textData.m_textBufferOffset + textData.m_textLength + 1;
+				textBufferSize = end > textBufferSize ? end : textBufferSize;
+			}
+		}
+
+		SetContext(src);
+		EndFrame();
+	}
+	printf("  %5d layers x %3d labels: merge %8.3fms, dst text buffer %9u bytes\n", _layerCount, _labelCount, best, textBufferSize);
+}
+
+void Benchmark_MergeText()
+{
+	const int layerCounts[] = { 50, 500, 2000 };
+	const int labelCounts[] = { 4, 32 };
+	for (int layerCount : layerCounts)
+	{
+		for (int labelCount : labelCounts)
+		{
+			MergeText(layerCount, labelCount);
+		}
+	}
+}
+
+struct Benchmark
+{
+	const char* m_name;
+	const char* m_description;
+	void      (*m_run)();
+};
+const Benchmark kBenchmarks[] =
+{
+	{ "transform",  "Vertex()/Vertices() recording rate with an identity and a rotation + scale + translation matrix", &Benchmark_Transform },
+	{ "sort",       "EndFrame() with sorted primitives vs. the previous qsort() based sort", &Benchmark_Sort },
+	{ "layers",     "Layer creation time and allocation count", &Benchmark_Layers },
+	{ "merge",      "MergeContexts() with 4/8/16 sources, sequential calls vs. one multi-source call (serial and threaded)", &Benchmark_MergeSources },
+	{ "merge_text", "MergeContexts() text, scaling layers and labels per layer", &Benchmark_MergeText },
+};
+
+} // namespace
+
+int main(int _argc, char** _argv)
+{
+	int runCount = 0;
+	for (const Benchmark& benchmark : kBenchmarks)
+	{
+		bool run = _argc < 2;
+		for (int i = 1; i < _argc; ++i)
+		{
+			run |= strcmp(_argv[i], benchmark.m_name) == 0;
+		}
+		if (run)
+		{
+			printf("%s: %s\n", benchmark.m_name, benchmark.m_description);
+			benchmark.m_run();
+			++runCount;
+		}
+	}
+	if (runCount == 0)
+	{
+		fprintf(stderr, "No benchmark matched, available:\n");
+		for (const Benchmark& benchmark : kBenchmarks)
+		{
+			fprintf(stderr, "  %s\n", benchmark.m_name);
+		}
+		return 1;
+	}
+	return 0;
+}
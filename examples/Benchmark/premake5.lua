@@ -0,0 +1,53 @@
+local IM3D_DIR = "../../"
+
+filter { "configurations:debug" }
+	defines { "IM3D_DEBUG" }
+	targetsuffix "_debug"
+	symbols "On"
+	optimize "Off"
+
+filter { "configurations:release" }
+	symbols "On"
+	optimize "Full"
+
+filter { "action:vs*" }
+	defines { "_CRT_SECURE_NO_WARNINGS", "_SCL_SECURE_NO_WARNINGS" }
+
+workspace "im3d_benchmark"
+	location(_ACTION)
+	configurations { "Debug", "Release" }
+	platforms { "x86", "x64" }
+	cppdialect "C++11"
+	staticruntime "On"
+
+	filter { "platforms:x86" }
+		architecture "x86"
+	filter { "platforms:x64" }
+		architecture "x86_64"
+
+	filter {}
+
+	vpaths({
+		["im3d"] = { IM3D_DIR .. "*.h", IM3D_DIR .. "*.cpp" },
+		["*"]    = { "*.cpp" },
+		})
+
+	files({
+		IM3D_DIR .. "*.h",
+		IM3D_DIR .. "*.cpp",
+		})
+
+	project "im3d_benchmark"
+		kind "ConsoleApp"
+		language "C++"
+		targetdir ""
+
+		includedirs({
+			IM3D_DIR,
+			})
+		files({
+			"*.cpp"
+			})
+
+		filter { "system:linux" }
+			links { "pthread" } -- std::thread, see ParallelForThreads()
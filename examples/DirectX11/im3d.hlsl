@@ -25,19 +25,32 @@ struct VS_OUTPUT
 	
 	struct VS_INPUT
 	{
-		float4 m_positionSize : POSITION_SIZE;
-		float4 m_color        : COLOR;
+		#ifdef IM3D_VERTEX_COMPACT
+		 // Im3d::VertexDataCompact: rgba6 (MSB = r) + size in 1/2 pixel units (8 LSBs)
+			float3 m_position     : POSITION;
+			uint   m_colorSize    : COLOR_SIZE;
+		#else
+			float4 m_positionSize : POSITION_SIZE;
+			float4 m_color        : COLOR;
+		#endif
 	};
 	
 	VS_OUTPUT main(VS_INPUT _in) 
 	{
+		#ifdef IM3D_VERTEX_COMPACT
+			float4 positionSize = float4(_in.m_position, float(_in.m_colorSize & 255u) * 0.5);
+			float4 color = float4(uint4(_in.m_colorSize >> 8u, _in.m_colorSize >> 14u, _in.m_colorSize >> 20u, _in.m_colorSize >> 26u) & 63u) / 63.0; // abgr, as below
+		#else
+			float4 positionSize = _in.m_positionSize;
+			float4 color = _in.m_color;
+		#endif
 		VS_OUTPUT ret;
-		ret.m_color = _in.m_color.abgr; // swizzle to correct endianness
+		ret.m_color = color.abgr; // swizzle to correct endianness
 		#if !defined(TRIANGLES)
-			ret.m_color.a *= smoothstep(0.0, 1.0, _in.m_positionSize.w / kAntialiasing);
+			ret.m_color.a *= smoothstep(0.0, 1.0, positionSize.w / kAntialiasing);
 		#endif
-		ret.m_size = max(_in.m_positionSize.w, kAntialiasing);
-		ret.m_position = mul(uViewProjMatrix, float4(_in.m_positionSize.xyz, 1.0));
+		ret.m_size = max(positionSize.w, kAntialiasing);
+		ret.m_position = mul(uViewProjMatrix, float4(positionSize.xyz, 1.0));
 		return ret;
 	}
 #endif
@@ -33,16 +33,23 @@ static ID3D11BlendState*         g_Im3dBlendState;
 static ID3D11DepthStencilState*  g_Im3dDepthStencilState;
 static ID3D11Buffer*             g_Im3dConstantBuffer;
 static ID3D11Buffer*             g_Im3dVertexBuffer;
+static ID3D11Buffer*             g_Im3dIndexBuffer; // only used for draw lists with m_indexData, e.g. if IM3D_INDEXED_DRAW_LISTS is enabled
 
 using namespace Im3d;
 
+#if IM3D_VERTEX_COMPACT
+	#define IM3D_VERTEX_DEFINES "IM3D_VERTEX_COMPACT\0"
+#else
+	#define IM3D_VERTEX_DEFINES ""
+#endif
+
 // Resource init/shutdown will be app specific. In general you'll need one shader for each of the 3
 // draw primitive types (points, lines, triangles), plus some number of vertex buffers.
 bool Im3d_Init()
 {
 	ID3D11Device* d3d = g_Example->m_d3dDevice;
 	{ // points shader
-		g_Im3dShaderPoints.m_vsBlob = LoadCompileShader("vs_" IM3D_DX11_VSHADER, "im3d.hlsl", "VERTEX_SHADER\0POINTS\0");
+		g_Im3dShaderPoints.m_vsBlob = LoadCompileShader("vs_" IM3D_DX11_VSHADER, "im3d.hlsl", "VERTEX_SHADER\0POINTS\0" IM3D_VERTEX_DEFINES);
 		if (!g_Im3dShaderPoints.m_vsBlob)
 		{
 			return false;
@@ -65,7 +72,7 @@ bool Im3d_Init()
 	}
 
 	{ // lines shader
-		g_Im3dShaderLines.m_vsBlob = LoadCompileShader("vs_" IM3D_DX11_VSHADER, "im3d.hlsl", "VERTEX_SHADER\0LINES\0");
+		g_Im3dShaderLines.m_vsBlob = LoadCompileShader("vs_" IM3D_DX11_VSHADER, "im3d.hlsl", "VERTEX_SHADER\0LINES\0" IM3D_VERTEX_DEFINES);
 		if (!g_Im3dShaderLines.m_vsBlob)
 		{
 			return false;
@@ -88,7 +95,7 @@ bool Im3d_Init()
 	}
 
 	{ // triangles shader
-		g_Im3dShaderTriangles.m_vsBlob = LoadCompileShader("vs_" IM3D_DX11_VSHADER, "im3d.hlsl", "VERTEX_SHADER\0TRIANGLES\0");
+		g_Im3dShaderTriangles.m_vsBlob = LoadCompileShader("vs_" IM3D_DX11_VSHADER, "im3d.hlsl", "VERTEX_SHADER\0TRIANGLES\0" IM3D_VERTEX_DEFINES);
 		if (!g_Im3dShaderTriangles.m_vsBlob)
 		{
 			return false;
@@ -105,8 +112,13 @@ bool Im3d_Init()
 
 	{	D3D11_INPUT_ELEMENT_DESC desc[] =
 			{
+			#if IM3D_VERTEX_COMPACT
+				{ "POSITION",      0, DXGI_FORMAT_R32G32B32_FLOAT,      0, (UINT)offsetof(Im3d::VertexDataCompact, m_position),  D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "COLOR_SIZE",    0, DXGI_FORMAT_R32_UINT,             0, (UINT)offsetof(Im3d::VertexDataCompact, m_colorSize), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			#else
 				{ "POSITION_SIZE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT,   0, (UINT)offsetof(Im3d::VertexData, m_positionSize), D3D11_INPUT_PER_VERTEX_DATA, 0 },
 				{ "COLOR",         0, DXGI_FORMAT_R8G8B8A8_UNORM,       0, (UINT)offsetof(Im3d::VertexData, m_color),        D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			#endif
 			};
 		dxAssert(d3d->CreateInputLayout(desc, 2, g_Im3dShaderPoints.m_vsBlob->GetBufferPointer(), g_Im3dShaderPoints.m_vsBlob->GetBufferSize(), &g_Im3dInputLayout));
 	}
@@ -150,6 +162,7 @@ void Im3d_Shutdown()
 	if (g_Im3dDepthStencilState)  g_Im3dDepthStencilState->Release();
 	if (g_Im3dConstantBuffer)     g_Im3dConstantBuffer->Release();
 	if (g_Im3dVertexBuffer)       g_Im3dVertexBuffer->Release();
+	if (g_Im3dIndexBuffer)        g_Im3dIndexBuffer->Release();
 }
 
 // At the top of each frame, the application must fill the Im3d::AppData struct and then call Im3d::NewFrame().
@@ -273,11 +286,30 @@ void Im3d_EndFrame()
 				g_Im3dVertexBuffer = nullptr;
 			}
 			s_vertexBufferSize = drawList.m_vertexCount;
-			g_Im3dVertexBuffer = CreateVertexBuffer(s_vertexBufferSize * sizeof(Im3d::VertexData), D3D11_USAGE_DYNAMIC);
+			g_Im3dVertexBuffer = CreateVertexBuffer(s_vertexBufferSize * sizeof(Im3d::DrawVertexData), D3D11_USAGE_DYNAMIC);
 		}
-		memcpy(MapBuffer(g_Im3dVertexBuffer, D3D11_MAP_WRITE_DISCARD), drawList.m_vertexData, drawList.m_vertexCount * sizeof(Im3d::VertexData));
+		memcpy(MapBuffer(g_Im3dVertexBuffer, D3D11_MAP_WRITE_DISCARD), drawList.m_vertexData, drawList.m_vertexCount * sizeof(Im3d::DrawVertexData));
 		UnmapBuffer(g_Im3dVertexBuffer);
 	
+	 // upload index data, indexed draw lists (IM3D_INDEXED_DRAW_LISTS) store vertices shared by strips/loops once and sorted
+	 // draw lists with AppData::m_sortIndexed keep vertices in submission order, drawing m_indexData gives the sorted order
+		static U32 s_indexBufferSize = 0;
+		if (drawList.m_indexData)
+		{
+			if (!g_Im3dIndexBuffer || s_indexBufferSize < drawList.m_indexCount)
+			{
+				if (g_Im3dIndexBuffer)
+				{
+					g_Im3dIndexBuffer->Release();
+					g_Im3dIndexBuffer = nullptr;
+				}
+				s_indexBufferSize = drawList.m_indexCount;
+				g_Im3dIndexBuffer = CreateIndexBuffer(s_indexBufferSize * sizeof(Im3d::U32), D3D11_USAGE_DYNAMIC);
+			}
+			memcpy(MapBuffer(g_Im3dIndexBuffer, D3D11_MAP_WRITE_DISCARD), drawList.m_indexData, drawList.m_indexCount * sizeof(Im3d::U32));
+			UnmapBuffer(g_Im3dIndexBuffer);
+		}
+	
 	 // select shader/primitive topo
 		switch (drawList.m_primType)
 		{
@@ -305,12 +337,20 @@ void Im3d_EndFrame()
 				return;
 		};
 	
-		UINT stride = sizeof(Im3d::VertexData);
+		UINT stride = sizeof(Im3d::DrawVertexData);
 		UINT offset = 0;
 		ctx->IASetVertexBuffers(0, 1, &g_Im3dVertexBuffer, &stride, &offset);
 		ctx->IASetInputLayout(g_Im3dInputLayout);
 		ctx->VSSetConstantBuffers(0, 1, &g_Im3dConstantBuffer);
-		ctx->Draw(drawList.m_vertexCount, 0);
+		if (drawList.m_indexData)
+		{
+			ctx->IASetIndexBuffer(g_Im3dIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+			ctx->DrawIndexed(drawList.m_indexCount, 0, 0);
+		}
+		else
+		{
+			ctx->Draw(drawList.m_vertexCount, 0);
+		}
 		
 		ctx->VSSetShader(nullptr, nullptr, 0);
 		ctx->GSSetShader(nullptr, nullptr, 0);
@@ -5,6 +5,10 @@
 */
 #include "im3d_example.h"
 
+#if IM3D_VERTEX_COMPACT
+	#error IM3D_VERTEX_COMPACT is not supported by this example, see examples/OpenGL33
+#endif
+
 static GLuint g_Im3dVertexArray;
 static GLuint g_Im3dVertexBuffer;
 static GLuint g_Im3dUniformBuffer;
@@ -256,21 +260,43 @@ void Im3d_EndFrame()
 		const int kMaxBufferSize = 64 * 1024; // assuming 64kb here but the application should check the implementation limit
 	 	const int kPrimsPerPass = kMaxBufferSize / (sizeof (Im3d::VertexData) * primVertexCount);
 	
-		int remainingPrimCount = drawList.m_vertexCount / primVertexCount;
+	 // Indexed draw lists (IM3D_INDEXED_DRAW_LISTS, or sorted with AppData::m_sortIndexed) can't be fetched directly by the shader,
+	 // gather each pass' vertices on the CPU. For sorted layers this is required for correct blending.
+		static Im3d::VertexData s_passVertexData[kMaxBufferSize / sizeof(Im3d::VertexData)];
+	
+		int remainingPrimCount = (drawList.m_indexData ? drawList.m_indexCount : drawList.m_vertexCount) / primVertexCount;
 		const Im3d::VertexData* vertexData = drawList.m_vertexData;
+		const Im3d::U32* indexData = drawList.m_indexData;
 		while (remainingPrimCount > 0)
 		{
 			int passPrimCount = remainingPrimCount < kPrimsPerPass ? remainingPrimCount : kPrimsPerPass;
 			int passVertexCount = passPrimCount * primVertexCount;
 	
+			const Im3d::VertexData* passVertexData = vertexData;
+			if (indexData)
+			{
+				for (int j = 0; j < passVertexCount; ++j)
+				{
+					s_passVertexData[j] = vertexData[indexData[j]];
+				}
+				passVertexData = s_passVertexData;
+			}
+	
 			glAssert(glBindBuffer(GL_UNIFORM_BUFFER, g_Im3dUniformBuffer));
-			glAssert(glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)passVertexCount * sizeof(Im3d::VertexData), (GLvoid*)vertexData, GL_DYNAMIC_DRAW));
+			glAssert(glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)passVertexCount * sizeof(Im3d::VertexData), (GLvoid*)passVertexData, GL_DYNAMIC_DRAW));
 	
 		 // instanced draw call, 1 instance per prim
 			glAssert(glBindBufferBase(GL_UNIFORM_BUFFER, 0, g_Im3dUniformBuffer));
 			glDrawArraysInstanced(prim, 0, prim == GL_TRIANGLES ? 3 : 4, passPrimCount); // for triangles just use the first 3 verts of the strip
 	
-			vertexData += passVertexCount;
+			if (indexData)
+			{
+				indexData += passVertexCount;
+			}
+			else
+			{
+				vertexData += passVertexCount;
+			}
 			remainingPrimCount -= passPrimCount;
 		}
 	}
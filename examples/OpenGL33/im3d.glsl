@@ -17,13 +17,23 @@
 #ifdef VERTEX_SHADER
 	uniform mat4 uViewProjMatrix;
 	
-	layout(location=0) in vec4 aPositionSize;
-	layout(location=1) in vec4 aColor;
+	#ifdef IM3D_VERTEX_COMPACT
+	 // Im3d::VertexDataCompact: rgba6 (MSB = r) + size in 1/2 pixel units (8 LSBs)
+		layout(location=0) in vec3 aPosition;
+		layout(location=1) in uint aColorSize;
+	#else
+		layout(location=0) in vec4 aPositionSize;
+		layout(location=1) in vec4 aColor;
+	#endif
 	
 	out VertexData vData;
 	
 	void main() 
 	{
+		#ifdef IM3D_VERTEX_COMPACT
+			vec4 aPositionSize = vec4(aPosition, float(aColorSize & 255u) * 0.5);
+			vec4 aColor = vec4(uvec4(aColorSize >> 8u, aColorSize >> 14u, aColorSize >> 20u, aColorSize >> 26u) & 63u) / 63.0; // abgr, as below
+		#endif
 		vData.m_color = aColor.abgr; // swizzle to correct endianness
 		#if !defined(TRIANGLES)
 			vData.m_color.a *= smoothstep(0.0, 1.0, aPositionSize.w / kAntialiasing);
@@ -6,17 +6,24 @@
 
 static GLuint g_Im3dVertexArray;
 static GLuint g_Im3dVertexBuffer;
+static GLuint g_Im3dIndexBuffer; // only used if IM3D_INDEXED_DRAW_LISTS is enabled
 static GLuint g_Im3dShaderPoints;
 static GLuint g_Im3dShaderLines;
 static GLuint g_Im3dShaderTriangles;
 
 using namespace Im3d;
 
+#if IM3D_VERTEX_COMPACT
+	#define IM3D_VERTEX_DEFINES "IM3D_VERTEX_COMPACT\0"
+#else
+	#define IM3D_VERTEX_DEFINES ""
+#endif
+
 // Resource init/shutdown will be app specific. In general you'll need one shader for each of the 3
 // draw primitive types (points, lines, triangles), plus some number of vertex buffers.
 bool Im3d_Init()
 {
-	{	GLuint vs = LoadCompileShader(GL_VERTEX_SHADER,   "im3d.glsl", "VERTEX_SHADER\0POINTS\0");
+	{	GLuint vs = LoadCompileShader(GL_VERTEX_SHADER,   "im3d.glsl", "VERTEX_SHADER\0POINTS\0" IM3D_VERTEX_DEFINES);
 		GLuint fs = LoadCompileShader(GL_FRAGMENT_SHADER, "im3d.glsl", "FRAGMENT_SHADER\0POINTS\0");
 		if (vs && fs) {
 			glAssert(g_Im3dShaderPoints = glCreateProgram());
@@ -36,7 +43,7 @@ bool Im3d_Init()
 		}
 	}
 
-	{	GLuint vs = LoadCompileShader(GL_VERTEX_SHADER,   "im3d.glsl", "VERTEX_SHADER\0LINES\0");
+	{	GLuint vs = LoadCompileShader(GL_VERTEX_SHADER,   "im3d.glsl", "VERTEX_SHADER\0LINES\0" IM3D_VERTEX_DEFINES);
 		GLuint gs = LoadCompileShader(GL_GEOMETRY_SHADER, "im3d.glsl", "GEOMETRY_SHADER\0LINES\0");
 		GLuint fs = LoadCompileShader(GL_FRAGMENT_SHADER, "im3d.glsl", "FRAGMENT_SHADER\0LINES\0");
 		if (vs && gs && fs)
@@ -60,7 +67,7 @@ bool Im3d_Init()
 		}
 	}
 
-	{	GLuint vs = LoadCompileShader(GL_VERTEX_SHADER,   "im3d.glsl", "VERTEX_SHADER\0TRIANGLES\0");
+	{	GLuint vs = LoadCompileShader(GL_VERTEX_SHADER,   "im3d.glsl", "VERTEX_SHADER\0TRIANGLES\0" IM3D_VERTEX_DEFINES);
 		GLuint fs = LoadCompileShader(GL_FRAGMENT_SHADER, "im3d.glsl", "FRAGMENT_SHADER\0TRIANGLES\0");
 		if (vs && fs)
 		{
@@ -82,13 +89,20 @@ bool Im3d_Init()
 	}
 
 	glAssert(glGenBuffers(1, &g_Im3dVertexBuffer));;
+	glAssert(glGenBuffers(1, &g_Im3dIndexBuffer));
 	glAssert(glGenVertexArrays(1, &g_Im3dVertexArray));	
 	glAssert(glBindVertexArray(g_Im3dVertexArray));
 	glAssert(glBindBuffer(GL_ARRAY_BUFFER, g_Im3dVertexBuffer));
 	glAssert(glEnableVertexAttribArray(0));
-	glAssert(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Im3d::VertexData), (GLvoid*)offsetof(Im3d::VertexData, m_positionSize)));
 	glAssert(glEnableVertexAttribArray(1));
-	glAssert(glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Im3d::VertexData), (GLvoid*)offsetof(Im3d::VertexData, m_color)));
+	#if IM3D_VERTEX_COMPACT
+		glAssert(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Im3d::VertexDataCompact), (GLvoid*)offsetof(Im3d::VertexDataCompact, m_position)));
+		glAssert(glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(Im3d::VertexDataCompact), (GLvoid*)offsetof(Im3d::VertexDataCompact, m_colorSize)));
+	#else
+		glAssert(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Im3d::VertexData), (GLvoid*)offsetof(Im3d::VertexData, m_positionSize)));
+		glAssert(glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Im3d::VertexData), (GLvoid*)offsetof(Im3d::VertexData, m_color)));
+	#endif
+	glAssert(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_Im3dIndexBuffer)); // element array binding is part of the vertex array state
 	glAssert(glBindVertexArray(0));
 
 	return true;
@@ -98,6 +112,7 @@ void Im3d_Shutdown()
 {
 	glAssert(glDeleteVertexArrays(1, &g_Im3dVertexArray));
 	glAssert(glDeleteBuffers(1, &g_Im3dVertexBuffer));
+	glAssert(glDeleteBuffers(1, &g_Im3dIndexBuffer));
 	glAssert(glDeleteProgram(g_Im3dShaderPoints));
 	glAssert(glDeleteProgram(g_Im3dShaderLines));
 	glAssert(glDeleteProgram(g_Im3dShaderTriangles));
@@ -169,6 +184,9 @@ void Im3d_NewFrame()
 	ad.m_snapRotation    = ctrlDown ? Im3d::Radians(30.0f) : 0.0f;
 	ad.m_snapScale       = ctrlDown ? 0.5f : 0.0f;
 
+ // Pack all draw lists into a single vertex (and index) buffer during EndFrame() so that it can be uploaded once, see Im3d_EndFrame().
+	ad.m_contiguousDrawData = true;
+
 	Im3d::NewFrame();
 }
 
@@ -187,6 +205,16 @@ void Im3d_EndFrame()
 	glAssert(glBlendEquation(GL_FUNC_ADD));
 	glAssert(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
 	glAssert(glEnable(GL_PROGRAM_POINT_SIZE));
+
+ // Upload all vertex/index data for the frame, draw lists then reference it via m_vertexOffset/m_indexOffset.
+	glAssert(glBindVertexArray(g_Im3dVertexArray));
+	glAssert(glBindBuffer(GL_ARRAY_BUFFER, g_Im3dVertexBuffer));
+	glAssert(glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)Im3d::GetFrameVertexCount() * sizeof(Im3d::DrawVertexData), (GLvoid*)Im3d::GetFrameVertexData(), GL_STREAM_DRAW));
+	if (Im3d::GetFrameIndexData())
+	{
+	 // Indexed draw lists (IM3D_INDEXED_DRAW_LISTS) store vertices shared by strips/loops once, with AppData::m_sortIndexed sorted draw lists carry the sorted order.
+		glAssert(glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)Im3d::GetFrameIndexCount() * sizeof(Im3d::U32), (GLvoid*)Im3d::GetFrameIndexData(), GL_STREAM_DRAW));
+	}
 		
 	for (U32 i = 0, n = Im3d::GetDrawListCount(); i < n; ++i)
 	{
@@ -221,15 +249,19 @@ void Im3d_EndFrame()
 				return;
 		};
 	
-		glAssert(glBindVertexArray(g_Im3dVertexArray));
-		glAssert(glBindBuffer(GL_ARRAY_BUFFER, g_Im3dVertexBuffer));
-		glAssert(glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)drawList.m_vertexCount * sizeof(Im3d::VertexData), (GLvoid*)drawList.m_vertexData, GL_STREAM_DRAW));
 	
 		AppData& ad = GetAppData();
 		glAssert(glUseProgram(sh));
 		glAssert(glUniform2f(glGetUniformLocation(sh, "uViewport"), ad.m_viewportSize.x, ad.m_viewportSize.y));
 		glAssert(glUniformMatrix4fv(glGetUniformLocation(sh, "uViewProjMatrix"), 1, false, (const GLfloat*)g_Example->m_camViewProj));
-		glAssert(glDrawArrays(prim, 0, (GLsizei)drawList.m_vertexCount));
+		if (drawList.m_indexData)
+		{
+			glAssert(glDrawElementsBaseVertex(prim, (GLsizei)drawList.m_indexCount, GL_UNSIGNED_INT, (GLvoid*)((size_t)drawList.m_indexOffset * sizeof(Im3d::U32)), (GLint)drawList.m_vertexOffset));
+		}
+		else
+		{
+			glAssert(glDrawArrays(prim, (GLint)drawList.m_vertexOffset, (GLsizei)drawList.m_vertexCount));
+		}
 	}
 
  // Text rendering.
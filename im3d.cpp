@@ -1,5 +1,30 @@
 /*	CHANGE LOG
 	==========
+	2026-10-16 (v1.17) - Bulk vertex submission API (Vertices()).
+	                   - SIMD matrix stack transforms (IM3D_SIMD).
+	                   - Optional indexed draw lists (IM3D_INDEXED_DRAW_LISTS), added DrawList::m_indexData/m_indexCount.
+	                   - Optional compact 16 byte draw list vertices (IM3D_VERTEX_COMPACT), DrawList::m_vertexData is a DrawVertexData*.
+	                   - App-provided vertex memory via Context::setVertexStorage() (VertexStorage).
+	                   - Contiguous frame data (AppData::m_contiguousDrawData, GetFrameVertexData()), added DrawList::m_vertexOffset/m_indexOffset.
+	                   - Stable radix sort for sorted primitives (replaces qsort).
+	                   - Optionally sort via an index permutation rather than reordering vertex data (AppData::m_sortIndexed).
+	                   - Optional incremental sorting seeded from the previous frame (AppData::m_sortIncremental).
+	                   - Hashed layer ID lookup.
+	                   - Per-layer lists are allocated in blocks.
+	                   - Per-layer enable state (SetLayerEnabled(), IsLayerEnabled()), recording into a disabled layer early-outs.
+	                   - Retained layers (SetLayerRetained(), InvalidateLayer()) keep their primitives across NewFrame().
+	                   - Free layers which are unused for AppData::m_layerMaxUnusedFrames.
+	                   - Only lists written during the frame (or retained) are visited by reset()/endFrame()/sort().
+	                   - Per-context allocator (Context(const Allocator&)), optional frame arena for transient data (AppData::m_frameArena).
+	                   - No allocations once warmed up, optional allocation tracking (IM3D_ALLOC_TRACKING, GetAllocStats(), AppData::m_allocWarmupFrames).
+	                   - Per-context/per-layer budgets (AppData::m_budget, SetLayerBudget(), GetBudgetStats()) with drop-new/drop-layer/keep-nearest policies.
+	                   - Optionally split unsorted vertex lists into pages so that growth never copies vertices, except within strips/loops (AppData::m_vertexPageSize).
+	                   - Optional reserve-and-commit virtual memory for vertex lists (IM3D_VIRTUAL_MEMORY, AppData::m_vertexListReserve).
+	                   - Triple-buffered frame snapshots (AppData::m_frameSnapshots, AcquireFrameSnapshot()) so that rendering can overlap recording.
+	                   - Optionally merge contexts by reference instead of copying unsorted vertex data (AppData::m_mergeLinked).
+	                   - MergeContexts() for multiple sources, copies run in parallel via AppData::parallelForCallback.
+	                   - Fixed MergeContexts() copying the whole source text buffer per layer, and merging text into the wrong layer.
+	                   - Optionally presort per-thread contexts before merging them (PresortForMerge()), the destination merges the sorted runs.
 	2020-05-17 (v1.16) - Text API.
 	                   - Flip gizmo axes when viewed from behind (AppData::m_flipGizmoWhenBehind).
 	                   - Minor gizmo rendering improvements.
@@ -25,10 +50,12 @@
 #include "im3d.h"
 #include "im3d_math.h"
 
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cfloat>
+#include <new>
 
 #ifndef va_copy
 	#define va_copy(_dst, _src) (_dst = _src)
@@ -52,6 +79,27 @@
 #ifndef IM3D_CULL_GIZMOS
 	#define IM3D_CULL_GIZMOS 0
 #endif
+#ifndef IM3D_SIMD
+	#define IM3D_SIMD 0
+#endif
+
+#if IM3D_SIMD
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define IM3D_SIMD_SSE2
+		#include <emmintrin.h>
+	#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		#define IM3D_SIMD_NEON
+		#include <arm_neon.h>
+	#endif
+#endif
+
+#if IM3D_VIRTUAL_MEMORY
+	#if defined(__unix__) || defined(__APPLE__)
+		#include <sys/mman.h>
+	#else
+		#error im3d: IM3D_VIRTUAL_MEMORY requires mmap()
+	#endif
+#endif
 
 // Compiler
 #if defined(__GNUC__)
@@ -144,6 +192,10 @@ void Im3d::Scale(float _x, float _y, float _z)
 void Im3d::DrawXyzAxes()
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	ctx.pushColor(ctx.getColor());
 	ctx.begin(PrimitiveMode_Lines);
 		ctx.vertex(Vec3(0.0f, 0.0f, 0.0f), ctx.getSize(), Color_Red);
@@ -159,6 +211,10 @@ void Im3d::DrawXyzAxes()
 void Im3d::DrawPoint(const Vec3& _position, float _size, Color _color)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	ctx.begin(PrimitiveMode_Points);
 		ctx.vertex(_position, _size, _color);
 	ctx.end();
@@ -166,6 +222,10 @@ void Im3d::DrawPoint(const Vec3& _position, float _size, Color _color)
 void Im3d::DrawLine(const Vec3& _a, const Vec3& _b, float _size, Color _color)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	ctx.begin(PrimitiveMode_Lines);
 		ctx.vertex(_a, _size, _color);
 		ctx.vertex(_b, _size, _color);
@@ -174,6 +234,10 @@ void Im3d::DrawLine(const Vec3& _a, const Vec3& _b, float _size, Color _color)
 void Im3d::DrawQuad(const Vec3& _a, const Vec3& _b, const Vec3& _c, const Vec3& _d)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	ctx.begin(PrimitiveMode_LineLoop);
 		ctx.vertex(_a);
 		ctx.vertex(_b);
@@ -184,6 +248,10 @@ void Im3d::DrawQuad(const Vec3& _a, const Vec3& _b, const Vec3& _c, const Vec3&
 void Im3d::DrawQuad(const Vec3& _origin, const Vec3& _normal, const Vec2& _size)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	ctx.pushMatrix(ctx.getMatrix() * LookAt(_origin, _origin + _normal, ctx.getAppData().m_worldUp));
 	DrawQuad(
 		Vec3(-_size.x,  _size.y, 0.0f),
@@ -196,6 +264,10 @@ void Im3d::DrawQuad(const Vec3& _origin, const Vec3& _normal, const Vec2& _size)
 void Im3d::DrawQuadFilled(const Vec3& _a, const Vec3& _b, const Vec3& _c, const Vec3& _d)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	ctx.begin(PrimitiveMode_Triangles);
 		ctx.vertex(_a);
 		ctx.vertex(_b);
@@ -208,6 +280,10 @@ void Im3d::DrawQuadFilled(const Vec3& _a, const Vec3& _b, const Vec3& _c, const
 void Im3d::DrawQuadFilled(const Vec3& _origin, const Vec3& _normal, const Vec2& _size)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	ctx.pushMatrix(ctx.getMatrix() * LookAt(_origin, _origin + _normal, ctx.getAppData().m_worldUp));
 	DrawQuadFilled(
 		Vec3(-_size.x, -_size.y, 0.0f),
@@ -220,6 +296,10 @@ void Im3d::DrawQuadFilled(const Vec3& _origin, const Vec3& _normal, const Vec2&
 void Im3d::DrawCircle(const Vec3& _origin, const Vec3& _normal, float _radius, int _detail)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	#if IM3D_CULL_PRIMITIVES
 		if (!ctx.isVisible(_origin, _radius))
 		{
@@ -247,6 +327,10 @@ void Im3d::DrawCircle(const Vec3& _origin, const Vec3& _normal, float _radius, i
 void Im3d::DrawCircleFilled(const Vec3& _origin, const Vec3& _normal, float _radius, int _detail)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	#if IM3D_CULL_PRIMITIVES
 		if (!ctx.isVisible(_origin, _radius))
 		{
@@ -281,6 +365,10 @@ void Im3d::DrawCircleFilled(const Vec3& _origin, const Vec3& _normal, float _rad
 void Im3d::DrawSphere(const Vec3& _origin, float _radius, int _detail)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	#if IM3D_CULL_PRIMITIVES
 		if (!ctx.isVisible(_origin, _radius))
 		{
@@ -322,6 +410,10 @@ void Im3d::DrawSphere(const Vec3& _origin, float _radius, int _detail)
 void Im3d::DrawSphereFilled(const Vec3& _origin, float _radius, int _detail)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	#if IM3D_CULL_PRIMITIVES
 		if (!ctx.isVisible(_origin, _radius))
 		{
@@ -372,6 +464,10 @@ void Im3d::DrawSphereFilled(const Vec3& _origin, float _radius, int _detail)
 void Im3d::DrawAlignedBox(const Vec3& _min, const Vec3& _max)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	#if IM3D_CULL_PRIMITIVES
 		if (!ctx.isVisible(_min, _max))
 		{
@@ -404,6 +500,10 @@ void Im3d::DrawAlignedBox(const Vec3& _min, const Vec3& _max)
 void Im3d::DrawAlignedBoxFilled(const Vec3& _min, const Vec3& _max)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	#if IM3D_CULL_PRIMITIVES
 		if (!ctx.isVisible(_min, _max))
 		{
@@ -459,6 +559,10 @@ void Im3d::DrawAlignedBoxFilled(const Vec3& _min, const Vec3& _max)
 void Im3d::DrawCylinder(const Vec3& _start, const Vec3& _end, float _radius, int _detail)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	#if IM3D_CULL_PRIMITIVES
 		if (!ctx.isVisible((_start + _end) * 0.5f, Max(Length2(_start - _end), _radius)))
 		{
@@ -502,6 +606,10 @@ void Im3d::DrawCylinder(const Vec3& _start, const Vec3& _end, float _radius, int
 void Im3d::DrawCapsule(const Vec3& _start, const Vec3& _end, float _radius, int _detail)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	#if IM3D_CULL_PRIMITIVES
 		if (!ctx.isVisible((_start + _end) * 0.5f, Max(Length2(_start - _end), _radius)))
 		{
@@ -561,6 +669,10 @@ void Im3d::DrawPrism(const Vec3& _start, const Vec3& _end, float _radius, int _s
 {
 	_sides = Max(_sides, 2);
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 	#if IM3D_CULL_PRIMITIVES
 		if (!ctx.isVisible((_start + _end) * 0.5f, Max(Length2(_start - _end), _radius)))
 		{
@@ -596,6 +708,10 @@ void Im3d::DrawPrism(const Vec3& _start, const Vec3& _end, float _radius, int _s
 void Im3d::DrawArrow(const Vec3& _start, const Vec3& _end, float _headLength, float _headThickness)
 {
 	Context& ctx = GetContext();
+	if (!ctx.isLayerRecording())
+	{
+		return;
+	}
 
 	if (_headThickness < 0.0f)
 	{
@@ -1298,12 +1414,15 @@ void AppData::setCullFrustum(const Mat4& _viewProj, bool _ndcZNegativeOneToOne)
 
 *******************************************************************************/
 
-static void* AlignedMalloc(size_t _size, size_t _align)
+static void* AlignedMalloc(size_t _size, size_t _align, const Allocator* _allocator = nullptr)
 {
 	IM3D_ASSERT(_size > 0);
 	IM3D_ASSERT(_align > 0);
 	size_t grow = (_align - 1) + sizeof(void*);
-	size_t mem = (size_t)IM3D_MALLOC(_size + grow);
+	size_t mem = (_allocator && _allocator->m_allocate)
+		? (size_t)_allocator->m_allocate(_size + grow, _allocator->m_userData)
+		: (size_t)IM3D_MALLOC(_size + grow)
+		;
 	if (mem)
 	{
 		size_t ret = (mem + grow) & (~(_align - 1));
@@ -1317,20 +1436,86 @@ static void* AlignedMalloc(size_t _size, size_t _align)
 		return nullptr;
 	}
 }
-static void AlignedFree(void* _ptr_)
+static void AlignedFree(void* _ptr_, const Allocator* _allocator = nullptr)
 {
 	void* mem = *((void**)((size_t)_ptr_ - sizeof(void*)));
-	IM3D_FREE(mem);
+	if (_allocator && _allocator->m_free)
+	{
+		_allocator->m_free(mem, _allocator->m_userData);
+	}
+	else
+	{
+		IM3D_FREE(mem);
+	}
+}
+// If memory allocated via _a may be freed via _b (null = IM3D_MALLOC/IM3D_FREE).
+static bool IsSameAllocator(const Allocator* _a, const Allocator* _b)
+{
+	if (_a == _b)
+	{
+		return true;
+	}
+	const Allocator def;
+	_a = _a ? _a : &def;
+	_b = _b ? _b : &def;
+	return _a->m_allocate == _b->m_allocate && _a->m_free == _b->m_free && _a->m_userData == _b->m_userData;
 }
 
-template <typename T>
-Vector<T>::~Vector()
+#if IM3D_VIRTUAL_MEMORY
+static const size_t kVirtualCommitSize     = 64 * 1024;       // Commit granularity (a multiple of the page size).
+static const size_t kVirtualCommitSizeHuge = 2 * 1024 * 1024; // Commit granularity with huge pages.
+
+static void* VirtualReserve(size_t _size, bool _hugePages)
 {
-	if (m_data)
+	void* ret = mmap(nullptr, _size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (ret == MAP_FAILED)
 	{
-		AlignedFree(m_data);
-		m_data = 0;
+		return nullptr;
 	}
+	#ifdef MADV_HUGEPAGE
+		if (_hugePages)
+		{
+			madvise(ret, _size, MADV_HUGEPAGE);
+		}
+	#endif
+	return ret;
+}
+static bool VirtualCommit(void* _ptr, size_t _size)
+{
+	return mprotect(_ptr, _size, PROT_READ | PROT_WRITE) == 0;
+}
+// Return the memory to the OS, the address range stays reserved.
+static void VirtualDecommit(void* _ptr, size_t _size, bool _hugePages)
+{
+	mmap(_ptr, _size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+	#ifdef MADV_HUGEPAGE
+		if (_hugePages)
+		{
+			madvise(_ptr, _size, MADV_HUGEPAGE);
+		}
+	#endif
+}
+static void VirtualRelease(void* _ptr, size_t _size)
+{
+	munmap(_ptr, _size);
+}
+static size_t VirtualRoundUp(size_t _size, bool _hugePages)
+{
+	const size_t granularity = _hugePages ? kVirtualCommitSizeHuge : kVirtualCommitSize;
+	return (_size + granularity - 1) & ~(granularity - 1);
+}
+// # elements of _elementSize which fit in _size bytes (clamped to U32).
+static U32 VirtualCapacity(size_t _size, size_t _elementSize)
+{
+	const size_t ret = _size / _elementSize;
+	return ret < (size_t)~0u ? (U32)ret : ~0u;
+}
+#endif
+
+template <typename T>
+Vector<T>::~Vector()
+{
+	release();
 }
 
 template <typename T>
@@ -1354,20 +1539,141 @@ void Vector<T>::reserve(U32 _capacity)
 	{
 		return;
 	}
-	T* data = (T*)AlignedMalloc(sizeof(T) * _capacity, alignof(T));
+	T* data = nullptr;
+	if (m_storage)
+	{
+		if (m_external && m_storage->m_grow)
+		{
+			data = (T*)m_storage->m_grow(m_data, sizeof(T) * m_size, sizeof(T) * _capacity, m_storage->m_userData);
+			if (data)
+			{
+				IM3D_ASSERT(((size_t)data & (alignof(T) - 1)) == 0);
+				m_data = data;
+				m_capacity = _capacity;
+				return;
+			}
+		}
+		if (m_storage->m_allocate)
+		{
+			data = (T*)m_storage->m_allocate(sizeof(T) * _capacity, m_storage->m_userData);
+			IM3D_ASSERT(((size_t)data & (alignof(T) - 1)) == 0);
+		}
+	}
+	const bool external = data != nullptr;
+	#if IM3D_VIRTUAL_MEMORY
+		if (!external)
+		{
+			data = commitVirtual(sizeof(T) * (size_t)_capacity);
+			if (data && data == m_data)
+			{
+			 // grow in place
+				m_capacity = VirtualCapacity(m_virtualCommitted, sizeof(T));
+				return;
+			}
+		}
+	#endif
+	if (!data)
+	{
+		data = (T*)AlignedMalloc(sizeof(T) * _capacity, alignof(T), m_allocator);
+	}
 	if (m_data)
 	{
 		memcpy(data, m_data, sizeof(T) * m_size);
-		AlignedFree(m_data);;
+		bool freeData = !m_external;
+		#if IM3D_VIRTUAL_MEMORY
+			freeData = freeData && (char*)m_data != m_virtual; // the reservation is kept until trimVirtual()/release()
+		#endif
+		if (freeData)
+		{
+			AlignedFree(m_data, m_allocator);
+		}
 	}
 	m_data = data;
 	m_capacity = _capacity;
+	m_external = external;
+	#if IM3D_VIRTUAL_MEMORY
+		if ((char*)m_data == m_virtual)
+		{
+			m_capacity = VirtualCapacity(m_virtualCommitted, sizeof(T));
+		}
+	#endif
+}
+
+#if IM3D_VIRTUAL_MEMORY
+template <typename T>
+T* Vector<T>::commitVirtual(size_t _size)
+{
+	if (!m_virtual)
+	{
+		if (m_virtualReserve == 0 || _size > m_virtualReserve)
+		{
+			return nullptr;
+		}
+		m_virtual = (char*)VirtualReserve(m_virtualReserve, m_virtualHugePages);
+		if (!m_virtual)
+		{
+			return nullptr;
+		}
+		m_virtualSize = m_virtualReserve;
+	}
+	if (_size > m_virtualSize)
+	{
+		return nullptr; // exceeds the reservation, fall back to the heap
+	}
+	if (_size > m_virtualCommitted)
+	{
+		size_t commit = VirtualRoundUp(_size, m_virtualHugePages);
+		commit = commit < m_virtualSize ? commit : m_virtualSize;
+		if (!VirtualCommit(m_virtual + m_virtualCommitted, commit - m_virtualCommitted))
+		{
+			return nullptr;
+		}
+		m_virtualCommitted = commit;
+	}
+	return (T*)m_virtual;
+}
+
+template <typename T>
+void Vector<T>::trimVirtual(size_t _size)
+{
+	if (!m_virtual)
+	{
+		return;
+	}
+	const bool inUse = (char*)m_data == m_virtual;
+	if (!inUse || (m_size == 0 && m_virtualReserve != m_virtualSize))
+	{
+	 // unused (e.g. the reservation was exceeded) or setVirtual() changed, reserve again on demand
+		if (inUse)
+		{
+			m_data = nullptr;
+			m_capacity = 0;
+		}
+		VirtualRelease(m_virtual, m_virtualSize);
+		m_virtual = nullptr;
+		m_virtualSize = 0;
+		m_virtualCommitted = 0;
+		return;
+	}
+	const size_t used = sizeof(T) * (size_t)m_size;
+	size_t keep = _size > used ? _size : used;
+	if (keep >= m_virtualCommitted)
+	{
+		return;
+	}
+	keep = VirtualRoundUp(keep, m_virtualHugePages);
+	if (keep < m_virtualCommitted)
+	{
+		VirtualDecommit(m_virtual + keep, m_virtualCommitted - keep, m_virtualHugePages);
+		m_virtualCommitted = keep;
+		m_capacity = VirtualCapacity(m_virtualCommitted, sizeof(T));
+	}
 }
+#endif
 
 template <typename T>
 void Vector<T>::resize(U32 _size, const T& _val)
 {
-	IM3D_ASSERT(_size >= m_size); // only support growing the vector
 	reserve(_size);
 	while (m_size < _size)
 	{
@@ -1379,7 +1685,6 @@ void Vector<T>::resize(U32 _size, const T& _val)
 template <typename T>
 void Vector<T>::resize(U32 _size)
 {
-	IM3D_ASSERT(_size >= m_size); // only support growing the vector
 	reserve(_size);
 	m_size = _size;
 }
@@ -1387,15 +1692,67 @@ void Vector<T>::resize(U32 _size)
 template <typename T>
 void Vector<T>::swap(Vector<T>& _a_, Vector<T>& _b_)
 {
+	IM3D_ASSERT(IsSameAllocator(_a_.m_allocator, _b_.m_allocator)); // internal memory would be freed via the wrong allocator
 	T* data        = _a_.m_data;
 	U32 capacity   = _a_.m_capacity;
 	U32 size       = _a_.m_size;
+	bool external  = _a_.m_external;
 	_a_.m_data     = _b_.m_data;
 	_a_.m_capacity = _b_.m_capacity;
 	_a_.m_size     = _b_.m_size;
+	_a_.m_external = _b_.m_external;
 	_b_.m_data     = data;
 	_b_.m_capacity = capacity;
 	_b_.m_size     = size;
+	_b_.m_external = external;
+	#if IM3D_VIRTUAL_MEMORY
+	 // swap the reservations (which may be in use), keep the settings
+		char* virt             = _a_.m_virtual;
+		size_t virtualSize     = _a_.m_virtualSize;
+		size_t virtualCommit   = _a_.m_virtualCommitted;
+		_a_.m_virtual          = _b_.m_virtual;
+		_a_.m_virtualSize      = _b_.m_virtualSize;
+		_a_.m_virtualCommitted = _b_.m_virtualCommitted;
+		_b_.m_virtual          = virt;
+		_b_.m_virtualSize      = virtualSize;
+		_b_.m_virtualCommitted = virtualCommit;
+	#endif
+}
+
+template <typename T>
+void Vector<T>::release()
+{
+	#if IM3D_VIRTUAL_MEMORY
+		if (m_virtual)
+		{
+			if ((char*)m_data == m_virtual)
+			{
+				m_data = nullptr; // not heap memory
+			}
+			VirtualRelease(m_virtual, m_virtualSize);
+			m_virtual          = nullptr;
+			m_virtualSize      = 0;
+			m_virtualCommitted = 0;
+		}
+	#endif
+	if (m_data && !m_external)
+	{
+		AlignedFree(m_data, m_allocator);
+	}
+	m_data     = nullptr;
+	m_size     = 0;
+	m_capacity = 0;
+	m_external = false;
+}
+
+template <typename T>
+void Vector<T>::reference(const T* _data, U32 _size)
+{
+	release();
+	m_data     = const_cast<T*>(_data); // never written, see isExternal()
+	m_size     = _size;
+	m_capacity = _size;
+	m_external = true;
 }
 
 template struct Im3d::Vector<bool>;
@@ -1412,9 +1769,161 @@ template struct Im3d::Vector<DrawList>;
 
 *******************************************************************************/
 
+// Lock-free triple buffer: the producer (endFrame()) fills m_back then exchanges it with m_middle, the consumer
+// (acquireFrameSnapshot()) exchanges m_front with m_middle if it was published since the last acquire.
+struct Context::FrameSnapshots
+{
+	static const U32 kFresh = 1u << 31; // m_middle was published but not acquired
+
+	struct Slot
+	{
+		FrameSnapshot          m_snapshot;
+		Vector<DrawList>       m_drawLists;
+		Vector<TextDrawList>   m_textDrawLists;
+		Vector<TextData>       m_textData;
+		Vector<char>           m_textBuffer;
+		Vector<DrawVertexData> m_vertexData;
+		Vector<U32>            m_indexData;
+		bool                   m_published = false;
+	};
+	Slot                 m_slots[3];
+	U32                  m_back           = 0;
+	std::atomic<U32>     m_middle         { 1 };
+	U32                  m_front          = 2;
+	const Vector<char>*  m_lastTextBuffer = nullptr; // Text buffer of the last published frame (retained text is copied from it during reset()), or null.
+};
+
 static Context g_DefaultContext;
 IM3D_THREAD_LOCAL Context* Im3d::internal::g_CurrentContext = &g_DefaultContext;
 
+namespace {
+ // Transform positions by the matrix stack top, passing w through (vertex size). Construct once and apply to many positions so that the matrix columns stay in registers.
+	struct PointTransform
+	{
+		#if defined(IM3D_SIMD_SSE2)
+			__m128 m_col[4];
+
+			PointTransform(const Mat4& _m)
+			{
+			 // w is cleared so that _w can be inserted with an add, writing w separately after the store defeats store forwarding
+				const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+				for (int i = 0; i < 4; ++i)
+				{
+					#ifdef IM3D_MATRIX_ROW_MAJOR
+						m_col[i] = _mm_setr_ps(_m(0, i), _m(1, i), _m(2, i), 0.0f);
+					#else
+						m_col[i] = _mm_and_ps(_mm_loadu_ps(_m.m + i * 4), mask);
+					#endif
+				}
+			}
+
+			void apply(const Vec3& _position, float _w, Vec4& out_) const
+			{
+				__m128 ret = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(m_col[0], _mm_set1_ps(_position.x)), _mm_mul_ps(m_col[1], _mm_set1_ps(_position.y))),
+					_mm_add_ps(_mm_mul_ps(m_col[2], _mm_set1_ps(_position.z)), _mm_add_ps(m_col[3], _mm_setr_ps(0.0f, 0.0f, 0.0f, _w)))
+					);
+				_mm_storeu_ps(&out_.x, ret);
+			}
+
+		#elif defined(IM3D_SIMD_NEON)
+			float32x4_t m_col[4];
+
+			PointTransform(const Mat4& _m)
+			{
+			 // see SSE2 path
+				for (int i = 0; i < 4; ++i)
+				{
+					const float col[4] = { _m(0, i), _m(1, i), _m(2, i), 0.0f };
+					m_col[i] = vld1q_f32(col);
+				}
+			}
+
+			void apply(const Vec3& _position, float _w, Vec4& out_) const
+			{
+				float32x4_t ret = vsetq_lane_f32(_w, m_col[3], 3);
+				ret = vmlaq_n_f32(ret, m_col[0], _position.x);
+				ret = vmlaq_n_f32(ret, m_col[1], _position.y);
+				ret = vmlaq_n_f32(ret, m_col[2], _position.z);
+				vst1q_f32(&out_.x, ret);
+			}
+
+		#else
+			const Mat4& m_mat;
+
+			PointTransform(const Mat4& _m): m_mat(_m) {}
+
+			void apply(const Vec3& _position, float _w, Vec4& out_) const
+			{
+				out_ = Vec4(m_mat * _position, _w);
+			}
+
+		#endif
+	};
+
+#if IM3D_VERTEX_COMPACT
+ // Pack color + size for VertexDataCompact: rgba8 -> rgba6 in the 24 MSBs, size in 1/2 pixel units in the 8 LSBs.
+	inline U32 PackColorSize(U32 _color, float _size)
+	{
+		float size = _size * 2.0f + 0.5f;
+		size = size < 0.0f ? 0.0f : (size > 255.0f ? 255.0f : size);
+		return (_color & 0xfc000000u)
+			| ((_color & 0x00fc0000u) << 2)
+			| ((_color & 0x0000fc00u) << 4)
+			| ((_color & 0x000000fcu) << 6)
+			| (U32)size
+			;
+	}
+
+	#if defined(IM3D_SIMD_SSE2)
+	 // Write xyz from _src + lane kLane of _colorSize.
+		template <int kLane>
+		inline void StoreCompact(const VertexData& _src, __m128 _colorSize, VertexDataCompact* dst_)
+		{
+			__m128 p = _mm_loadu_ps(&_src.m_positionSize.x);
+			__m128 t = _mm_shuffle_ps(p, _colorSize, _MM_SHUFFLE(kLane, kLane, 2, 2)); // = z, z, cs, cs
+			_mm_storeu_ps((float*)dst_, _mm_shuffle_ps(p, t, _MM_SHUFFLE(2, 0, 1, 0)));
+		}
+	#endif
+
+ // Convert vertex data to the compact layout (IM3D_VERTEX_COMPACT).
+	void ConvertVertexData(const VertexData* _src, U32 _count, VertexDataCompact* dst_)
+	{
+		U32 i = 0;
+		#if defined(IM3D_SIMD_SSE2)
+		 // 4 vertices per iteration, see PackColorSize()
+			const __m128i maskR = _mm_set1_epi32((int)0xfc000000u);
+			const __m128i maskG = _mm_set1_epi32((int)0x00fc0000u);
+			const __m128i maskB = _mm_set1_epi32((int)0x0000fc00u);
+			const __m128i maskA = _mm_set1_epi32((int)0x000000fcu);
+			for (; i + 4 <= _count; i += 4)
+			{
+				const VertexData* src = _src + i;
+				__m128i color = _mm_setr_epi32((int)src[0].m_color.v, (int)src[1].m_color.v, (int)src[2].m_color.v, (int)src[3].m_color.v);
+				__m128  size  = _mm_setr_ps(src[0].m_positionSize.w, src[1].m_positionSize.w, src[2].m_positionSize.w, src[3].m_positionSize.w);
+				size = _mm_add_ps(_mm_mul_ps(size, _mm_set1_ps(2.0f)), _mm_set1_ps(0.5f));
+				size = _mm_min_ps(_mm_max_ps(size, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+				__m128i colorSize = _mm_or_si128(
+					_mm_or_si128(_mm_and_si128(color, maskR), _mm_slli_epi32(_mm_and_si128(color, maskG), 2)),
+					_mm_or_si128(_mm_slli_epi32(_mm_and_si128(color, maskB), 4), _mm_slli_epi32(_mm_and_si128(color, maskA), 6))
+					);
+				colorSize = _mm_or_si128(colorSize, _mm_cvttps_epi32(size));
+				const __m128 cs = _mm_castsi128_ps(colorSize);
+				StoreCompact<0>(src[0], cs, dst_ + i + 0);
+				StoreCompact<1>(src[1], cs, dst_ + i + 1);
+				StoreCompact<2>(src[2], cs, dst_ + i + 2);
+				StoreCompact<3>(src[3], cs, dst_ + i + 3);
+			}
+		#endif
+		for (; i < _count; ++i)
+		{
+			dst_[i].m_position  = Vec3(_src[i].m_positionSize);
+			dst_[i].m_colorSize = PackColorSize(_src[i].m_color.v, _src[i].m_positionSize.w);
+		}
+	}
+#endif
+}
+
 void Context::begin(PrimitiveMode _mode)
 {
 	IM3D_ASSERT(!m_endFrameCalled); // Begin*() called after EndFrame() but before NewFrame(), or forgot to call NewFrame()
@@ -1438,7 +1947,30 @@ void Context::begin(PrimitiveMode _mode)
 		default:
 			break;
 	};
+	m_primVertexBudget = ~0u;
+	m_primPageSize = ~0u;
+	if (m_layerRecording)
+	{
+		markListActive(m_vertexDataIndex, m_layerIndex * DrawPrimitive_Count + m_primType);
+		if (m_appData.m_budget.m_maxVertices || (m_layerFlags[m_layerIndex] & (LayerFlags_Budget | LayerFlags_Dropped)))
+		{
+			updatePrimBudget(); // before reading the list sizes, may trim the lists (see keepNearest())
+		}
+		if (m_appData.m_vertexPageSize && m_vertexDataIndex == 0)
+		{
+			sealPage(m_layerIndex * DrawPrimitive_Count + m_primType, 0);
+		 // strips/loops reference the previous vertices, a dropped primitive must be in a single list (see dropPrimitive())
+			const bool independent = m_primMode == PrimitiveMode_Points || m_primMode == PrimitiveMode_Lines || m_primMode == PrimitiveMode_Triangles;
+			if (independent && m_primVertexBudget == ~0u)
+			{
+				m_primPageSize = m_appData.m_vertexPageSize;
+			}
+		}
+	}
 	m_firstVertThisPrim = getCurrentVertexList()->size();
+	#if IM3D_INDEXED_DRAW_LISTS
+		m_firstIndexThisPrim = getCurrentIndexList()->size();
+	#endif
 }
 
 void Context::end()
@@ -1446,7 +1978,6 @@ void Context::end()
 	IM3D_ASSERT(m_primMode != PrimitiveMode_None); // End() called without Begin*()
 	if (m_vertCountThisPrim > 0)
 	{
-		VertexList* vertexList = getCurrentVertexList();
 		switch (m_primMode)
 		{
 			case PrimitiveMode_Points:
@@ -1459,9 +1990,18 @@ void Context::end()
 				break;
 			case PrimitiveMode_LineLoop:
 				IM3D_ASSERT(m_vertCountThisPrim > 1);
-				vertexList->push_back(vertexList->back());
-				vertexList->push_back((*vertexList)[m_firstVertThisPrim]);
+			{
+				#if IM3D_INDEXED_DRAW_LISTS
+					IndexList* indexList = getCurrentIndexList();
+					indexList->push_back(indexList->back());
+					indexList->push_back(m_firstVertThisPrim);
+				#else
+					VertexList* vertexList = getCurrentVertexList();
+					vertexList->push_back(vertexList->back());
+					vertexList->push_back((*vertexList)[m_firstVertThisPrim]);
+				#endif
 				break;
+			}
 			case PrimitiveMode_Triangles:
 				IM3D_ASSERT(m_vertCountThisPrim % 3 == 0);
 				break;
@@ -1477,9 +2017,17 @@ void Context::end()
 			m_maxVertThisPrim = m_maxVertThisPrim + Vec3(1.0f);
 			if (!isVisible(m_minVertThisPrim, m_maxVertThisPrim))
 			{
-				vertexList->resize(m_firstVertThisPrim, VertexData());
+				getCurrentVertexList()->resize(m_firstVertThisPrim);
+				#if IM3D_INDEXED_DRAW_LISTS
+					getCurrentIndexList()->resize(m_firstIndexThisPrim, 0);
+				#endif
 			}
 		#endif
+		#if IM3D_INDEXED_DRAW_LISTS
+			m_budgetStats.m_vertexCount += getCurrentIndexList()->size() - m_firstIndexThisPrim;
+		#else
+			m_budgetStats.m_vertexCount += getCurrentVertexList()->size() - m_firstVertThisPrim;
+		#endif
 	}
 	m_primMode = PrimitiveMode_None;
 	m_primType = DrawPrimitive_Count;
@@ -1503,11 +2051,20 @@ void Context::end()
 void Context::vertex(const Vec3& _position, float _size, Color _color)
 {
 	IM3D_ASSERT(m_primMode != PrimitiveMode_None); // Vertex() called without Begin*()
+	if (!m_layerRecording)
+	{
+		return;
+	}
+	if (m_vertCountThisPrim >= m_primVertexBudget)
+	{
+		dropPrimitive(1);
+		return;
+	}
 
 	VertexData vd(_position, _size, _color);
 	if (m_matrixStack.size() > 1) // optim, skip the matrix multiplication when the stack size is 1
 	{
-		vd.m_positionSize = Vec4(m_matrixStack.back() * _position, _size);
+		PointTransform(m_matrixStack.back()).apply(_position, _size, vd.m_positionSize);
 	}
 	vd.m_color.setA(vd.m_color.getA() * m_alphaStack.back());
 
@@ -1525,34 +2082,73 @@ void Context::vertex(const Vec3& _position, float _size, Color _color)
 	#endif
 
 	VertexList* vertexList = getCurrentVertexList();
-	switch (m_primMode)
-	{
-		case PrimitiveMode_Points:
-		case PrimitiveMode_Lines:
-		case PrimitiveMode_Triangles:
-			vertexList->push_back(vd);
-			break;
-		case PrimitiveMode_LineStrip:
-		case PrimitiveMode_LineLoop:
-			if (m_vertCountThisPrim >= 2)
-			{
-				vertexList->push_back(vertexList->back());
-				++m_vertCountThisPrim;
-			}
-			vertexList->push_back(vd);
-			break;
-		case PrimitiveMode_TriangleStrip:
-			if (m_vertCountThisPrim >= 3)
-			{
-				vertexList->push_back(*(vertexList->end() - 2));
-				vertexList->push_back(*(vertexList->end() - 2));
-				m_vertCountThisPrim += 2;
-			}
-			vertexList->push_back(vd);
-			break;
-		default:
-			break;
-	};
+	#if IM3D_INDEXED_DRAW_LISTS
+		IndexList* indexList = getCurrentIndexList();
+		if (indexList->size() >= m_primPageSize && m_vertCountThisPrim % VertsPerDrawPrimitive[m_primType] == 0)
+		{
+			splitPrimitive();
+		}
+
+	 // each vertex is stored once, strip modes duplicate the previous indices instead
+		const U32 index = vertexList->size();
+		vertexList->push_back(vd);
+		switch (m_primMode)
+		{
+			case PrimitiveMode_LineStrip:
+			case PrimitiveMode_LineLoop:
+				if (m_vertCountThisPrim >= 2)
+				{
+					indexList->push_back(indexList->back());
+					++m_vertCountThisPrim;
+				}
+				break;
+			case PrimitiveMode_TriangleStrip:
+				if (m_vertCountThisPrim >= 3)
+				{
+					indexList->push_back(*(indexList->end() - 2));
+					indexList->push_back(*(indexList->end() - 2));
+					m_vertCountThisPrim += 2;
+				}
+				break;
+			default:
+				break;
+		};
+		indexList->push_back(index);
+	#else
+		if (vertexList->size() >= m_primPageSize && m_vertCountThisPrim % VertsPerDrawPrimitive[m_primType] == 0)
+		{
+			splitPrimitive();
+		}
+
+		switch (m_primMode)
+		{
+			case PrimitiveMode_Points:
+			case PrimitiveMode_Lines:
+			case PrimitiveMode_Triangles:
+				vertexList->push_back(vd);
+				break;
+			case PrimitiveMode_LineStrip:
+			case PrimitiveMode_LineLoop:
+				if (m_vertCountThisPrim >= 2)
+				{
+					vertexList->push_back(vertexList->back());
+					++m_vertCountThisPrim;
+				}
+				vertexList->push_back(vd);
+				break;
+			case PrimitiveMode_TriangleStrip:
+				if (m_vertCountThisPrim >= 3)
+				{
+					vertexList->push_back(*(vertexList->end() - 2));
+					vertexList->push_back(*(vertexList->end() - 2));
+					m_vertCountThisPrim += 2;
+				}
+				vertexList->push_back(vd);
+				break;
+			default:
+				break;
+		};
+	#endif
 	++m_vertCountThisPrim;
 
 	#if 0
@@ -1604,19 +2200,181 @@ void Context::vertex(const Vec3& _position, float _size, Color _color)
 	#endif
 }
 
+void Context::vertices(const Vec3* _positions, const float* _sizes, const Color* _colors, U32 _count)
+{
+	IM3D_ASSERT(m_primMode != PrimitiveMode_None); // Vertices() called without Begin*()
+	if (_count == 0 || !m_layerRecording)
+	{
+		return;
+	}
+
+ // missing sizes/colors read the draw state via a 0 stride
+	const float defaultSize  = getSize();
+	const Color defaultColor = getColor();
+	const U32   sizeStride   = _sizes  ? 1 : 0;
+	const U32   colorStride  = _colors ? 1 : 0;
+	_sizes  = _sizes  ? _sizes  : &defaultSize;
+	_colors = _colors ? _colors : &defaultColor;
+
+ // fill the current list up to the page size (rounded up to a primitive boundary), continue in a new page
+	if (m_primPageSize != ~0u)
+	{
+		const U32 vertsPerPrim = VertsPerDrawPrimitive[m_primType];
+		for (;;)
+		{
+			#if IM3D_INDEXED_DRAW_LISTS
+				const U32 size = getCurrentIndexList()->size();
+			#else
+				const U32 size = getCurrentVertexList()->size();
+			#endif
+			U32 count = size < m_primPageSize ? m_primPageSize - size : 0;
+			count += (vertsPerPrim - (m_vertCountThisPrim + count) % vertsPerPrim) % vertsPerPrim;
+			if (count >= _count)
+			{
+				break;
+			}
+			if (count > 0)
+			{
+				appendVertices(_positions, _sizes, sizeStride, _colors, colorStride, count);
+				_positions += count;
+				_sizes     += count * sizeStride;
+				_colors    += count * colorStride;
+				_count     -= count;
+			}
+			splitPrimitive();
+		}
+	}
+	appendVertices(_positions, _sizes, sizeStride, _colors, colorStride, _count);
+}
+
+void Context::appendVertices(const Vec3* _positions, const float* _sizes, U32 _sizeStride, const Color* _colors, U32 _colorStride, U32 _count)
+{
+	const bool           transform = m_matrixStack.size() > 1; // optim, skip the matrix multiplication when the stack size is 1
+	const PointTransform matrix(m_matrixStack.back());
+	const float          alpha = m_alphaStack.back();
+
+ // strip modes duplicate the previous 1 or 2 vertices (or indices) once the first primitive is complete (see vertex()), compute the final count up front so that we only reserve once
+	U32 dupCount = 0;
+	U32 dupStart = 0;
+	switch (m_primMode)
+	{
+		case PrimitiveMode_LineStrip:
+		case PrimitiveMode_LineLoop:
+			dupCount = 1;
+			dupStart = m_vertCountThisPrim >= 2 ? 0 : 2 - m_vertCountThisPrim;
+			break;
+		case PrimitiveMode_TriangleStrip:
+			dupCount = 2;
+			dupStart = m_vertCountThisPrim >= 3 ? 0 : 3 - m_vertCountThisPrim;
+			break;
+		default:
+			break;
+	};
+	dupStart = dupStart < _count ? dupStart : _count;
+	const U32 writeCount = _count + (_count - dupStart) * dupCount;
+	if (m_vertCountThisPrim + writeCount > m_primVertexBudget)
+	{
+		dropPrimitive(_count);
+		return;
+	}
+
+	VertexList* vertexList = getCurrentVertexList();
+	const U32 first = vertexList->size();
+	#if IM3D_INDEXED_DRAW_LISTS
+		IndexList* indexList = getCurrentIndexList();
+		const U32 firstIndex = indexList->size();
+		indexList->resize(firstIndex + writeCount);
+		U32* dstIndex = indexList->data() + firstIndex;
+		vertexList->resize(first + _count);
+	#else
+		vertexList->resize(first + writeCount);
+	#endif
+	VertexData* dst = vertexList->data() + first;
+
+	for (U32 i = 0; i < _count; ++i)
+	{
+		VertexData vd(_positions[i], _sizes[i * _sizeStride], _colors[i * _colorStride]);
+		if (transform)
+		{
+			matrix.apply(_positions[i], vd.m_positionSize.w, vd.m_positionSize);
+		}
+		vd.m_color.setA(vd.m_color.getA() * alpha);
+
+		#if IM3D_CULL_PRIMITIVES
+			Vec3 p = Vec3(vd.m_positionSize);
+			if (m_vertCountThisPrim == 0 && i == 0) // p is the first vertex
+			{
+				m_minVertThisPrim = m_maxVertThisPrim = p;
+			}
+			else
+			{
+				m_minVertThisPrim = Min(m_minVertThisPrim, p);
+				m_maxVertThisPrim = Max(m_maxVertThisPrim, p);
+			}
+		#endif
+
+		#if IM3D_INDEXED_DRAW_LISTS
+			if (i >= dupStart)
+			{
+				if (dupCount == 1)
+				{
+					dstIndex[0] = dstIndex[-1];
+				}
+				else if (dupCount == 2)
+				{
+					dstIndex[0] = dstIndex[-2];
+					dstIndex[1] = dstIndex[-1];
+				}
+				dstIndex += dupCount;
+			}
+			*dstIndex++ = first + i;
+		#else
+			if (i >= dupStart)
+			{
+				if (dupCount == 1)
+				{
+					dst[0] = dst[-1];
+				}
+				else if (dupCount == 2)
+				{
+					dst[0] = dst[-2];
+					dst[1] = dst[-1];
+				}
+				dst += dupCount;
+			}
+		#endif
+		*dst++ = vd;
+	}
+	IM3D_ASSERT(dst == vertexList->end());
+	m_vertCountThisPrim += writeCount;
+}
+
 void Context::text(const Vec3& _position, float _size, Color _color, TextFlags _flags, const char* _textStart, const char* _textEnd)
 {
+	if (!m_layerRecording)
+	{
+		return;
+	}
+	const U32 textLength = (U32)(_textEnd - _textStart);
+	if ((m_appData.m_budget.m_maxTextBytes || (m_layerFlags[m_layerIndex] & (LayerFlags_Budget | LayerFlags_Dropped))) && !checkTextBudget(textLength + 1))
+	{
+		return;
+	}
+	markTextActive(m_layerIndex);
+	m_budgetStats.m_textBytes += textLength + 1;
+	m_layerLists[m_layerIndex]->m_textBytes += textLength + 1;
+
 	TextData& td = getCurrentTextList()->push_back();
 	td.m_positionSize = Vec4(_position, _size);
 	if (m_matrixStack.size() > 1) // optim, skip the matrix multiplication when the stack size is 1
 	{
-		td.m_positionSize = Vec4(m_matrixStack.back() * _position, _size);
+		PointTransform(m_matrixStack.back()).apply(_position, _size, td.m_positionSize);
 	}
 	td.m_color = _color;
 	td.m_color.setA(td.m_color.getA() * m_alphaStack.back());
 	td.m_flags = _flags;
 	td.m_textBufferOffset = m_textBuffer.size();
-	td.m_textLength = (U32)(_textEnd - _textStart);
+	td.m_textLength = textLength;
 
 	const U32 copyOffset = m_textBuffer.size();
 	m_textBuffer.resize(copyOffset + td.m_textLength + 1);
@@ -1627,29 +2385,48 @@ void Context::text(const Vec3& _position, float _size, Color _color, TextFlags _
 
 void Context::text(const Vec3& _position, float _size, Color _color, TextFlags _flags, const char* _text, va_list _args)
 {
+	if (!m_layerRecording)
+	{
+		return;
+	}
+	va_list argsCopy;
+	va_copy(argsCopy, _args); // vsnprintf() consumes the va_list, copy it for each call
+	const U32 textLength = (U32)vsnprintf(nullptr, 0, _text, argsCopy);
+	va_end(argsCopy);
+	if ((m_appData.m_budget.m_maxTextBytes || (m_layerFlags[m_layerIndex] & (LayerFlags_Budget | LayerFlags_Dropped))) && !checkTextBudget(textLength + 1))
+	{
+		return;
+	}
+	markTextActive(m_layerIndex);
+	m_budgetStats.m_textBytes += textLength + 1;
+	m_layerLists[m_layerIndex]->m_textBytes += textLength + 1;
+
 	TextData& td = getCurrentTextList()->push_back();
 	td.m_positionSize = Vec4(_position, _size);
 	if (m_matrixStack.size() > 1) // optim, skip the matrix multiplication when the stack size is 1
 	{
-		td.m_positionSize = Vec4(m_matrixStack.back() * _position, _size);
+		PointTransform(m_matrixStack.back()).apply(_position, _size, td.m_positionSize);
 	}
 	td.m_color = _color;
 	td.m_color.setA(td.m_color.getA() * m_alphaStack.back());
 	td.m_flags = _flags;
 	td.m_textBufferOffset = m_textBuffer.size();
-
-	va_list argsCopy;
-	va_copy(argsCopy, _args);
-	td.m_textLength = (U32)vsnprintf(nullptr, 0, _text, argsCopy);
+	td.m_textLength = textLength;
 
 	const U32 copyOffset = m_textBuffer.size();
 	m_textBuffer.resize(copyOffset + td.m_textLength + 1);
+	va_copy(argsCopy, _args);
 	vsnprintf(m_textBuffer.data() + copyOffset, td.m_textLength + 1, _text, argsCopy);
+	va_end(argsCopy);
 	m_textBuffer.back() = '\0';
 }
 
 void Context::reset()
 {
+	m_allocStats.m_frameAllocCount = 0;
+	m_allocStats.m_frameAllocBytes = 0;
+	m_budgetStats = BudgetStats();
+
  // all state stacks should be default here, else there was a mismatched Push*()/Pop*()
 	IM3D_ASSERT(m_colorStack.size() == 1);
 	IM3D_ASSERT(m_alphaStack.size() == 1);
@@ -1663,19 +2440,160 @@ void Context::reset()
 	m_primMode = PrimitiveMode_None;
 	m_primType = DrawPrimitive_Count;
 
+	const bool frameDataPacked = IM3D_VERTEX_COMPACT || m_appData.m_contiguousDrawData || m_appData.m_frameSnapshots;
+	if (frameDataPacked != m_frameDataPacked)
+	{
+	 // inactive lists keep their storage between frames, update all lists if the packing mode changed
+		m_frameDataPacked = frameDataPacked;
+		for (U32 i = 0; i < m_vertexData[0].size(); ++i)
+		{
+			const bool retained = (m_layerFlags[i / DrawPrimitive_Count] & LayerFlags_Recorded) != 0;
+			for (U32 j = 0; j < 2; ++j)
+			{
+				m_vertexData[j][i]->setStorage(m_frameDataPacked || retained ? nullptr : &m_vertexStorage);
+			}
+		}
+	}
+
+ // retained layers are kept if they were recorded during the previous frame (or earlier)
+	for (U32 i : m_usedLayers)
+	{
+		U32& flags = m_layerFlags[i];
+		if ((flags & LayerFlags_Used) == 0)
+		{
+			continue;
+		}
+		if ((flags & LayerFlags_Retained) && !(flags & (LayerFlags_Disabled | LayerFlags_Dropped)))
+		{
+			flags |= LayerFlags_Recorded;
+		}
+		m_layerLastUsed[i] = m_frameIndex;
+		flags &= ~LayerFlags_Used;
+	}
+	m_usedLayers.clear();
+ // dropped layers record again (and a dropped retained layer re-records its data, see above)
+	for (U32 i : m_droppedLayers)
+	{
+		m_layerFlags[i] &= ~LayerFlags_Dropped;
+	}
+	m_droppedLayers.clear();
+	++m_frameIndex;
+
+ // only lists which were written (or retained) need to be cleared
 	IM3D_ASSERT(m_vertexData[0].size() == m_vertexData[1].size());
-	for (U32 i = 0; i < m_vertexData[0].size(); ++i)
+	for (U32 j = 0; j < 2; ++j)
 	{
-		m_vertexData[0][i]->clear();
-		m_vertexData[1][i]->clear();
+		U32 activeCount = 0;
+		for (U32 i : m_activeLists[j])
+		{
+			if (j == 1)
+			{
+				clearSortKeys(i); // the view origin changes, retained data is sorted again
+			}
+			VertexList& vertexList = *m_vertexData[j][i];
+			if (m_layerFlags[i / DrawPrimitive_Count] & LayerFlags_Recorded)
+			{
+			 // keep the data, copy out of app-owned memory (see VertexStorage) which is only valid for 1 frame
+				for (U32 page = 0; page < getPageCount(j, i); ++page)
+				{
+					VertexList& pageList = getPageVertexList(j, i, page);
+					if (pageList.isExternal())
+					{
+						VertexList tmp;
+						tmp.setAllocator(&m_allocator);
+						tmp.append(pageList);
+						VertexList::swap(pageList, tmp);
+						tmp.release();
+					}
+				}
+				vertexList.setStorage(nullptr);
+				m_activeLists[j][activeCount++] = i;
+				continue;
+			}
+			if (j == 0)
+			{
+				releasePages(i);
+			}
+			if (vertexList.isExternal())
+			{
+				vertexList.release(); // app-owned memory (see VertexStorage) is only valid for 1 frame
+			}
+			else
+			{
+				vertexList.clear();
+			}
+			vertexList.setStorage(m_frameDataPacked ? nullptr : &m_vertexStorage); // if packed, VertexStorage is used for m_frameVertexData
+			#if IM3D_INDEXED_DRAW_LISTS
+				m_indexData[j][i]->clear();
+			#endif
+			#if IM3D_VIRTUAL_MEMORY
+				const size_t keep = m_appData.m_vertexListKeep ? m_appData.m_vertexListKeep : ~(size_t)0;
+				vertexList.trimVirtual(keep);
+				#if IM3D_INDEXED_DRAW_LISTS
+					m_indexData[j][i]->trimVirtual(keep);
+				#endif
+			#endif
+			m_listActive[j][i] = false;
+		}
+		m_activeLists[j].resize(activeCount);
 	}
 	m_drawLists.clear();
-	for (U32 i = 0; i < m_textData.size(); ++i)
+	m_frameTextData.clear();
+	if (m_frameVertexData.isExternal())
+	{
+		m_frameVertexData.release(); // see above
+	}
+	m_frameVertexData.clear();
+	m_frameVertexOffsets.clear();
+	#if IM3D_INDEXED_DRAW_LISTS
+		m_frameIndexData.clear();
+		m_frameIndexOffsets.clear();
+	#else
+		m_sortedIndexData.clear();
+	#endif
+	Vector<char>& textBuffer = m_textBufferScratch;
+	textBuffer.clear();
+ // if the last frame was published, m_textBuffer belongs to an older snapshot
+	const Vector<char>& prevTextBuffer = m_frameSnapshots->m_lastTextBuffer ? *m_frameSnapshots->m_lastTextBuffer : m_textBuffer;
+	m_frameSnapshots->m_lastTextBuffer = nullptr;
+	U32 activeTextCount = 0;
+	for (U32 i : m_activeTextLayers)
 	{
-		m_textData[i]->clear();
+		if ((m_layerFlags[i] & LayerFlags_Recorded) == 0)
+		{
+			m_textData[i]->clear();
+			m_layerLists[i]->m_textBytes = 0;
+			m_layerFlags[i] &= ~LayerFlags_TextActive;
+			continue;
+		}
+	 // move retained text to the front of m_textBuffer
+		for (TextData& td : *m_textData[i])
+		{
+			const U32 offset = textBuffer.size();
+			textBuffer.append(prevTextBuffer.data() + td.m_textBufferOffset, td.m_textLength + 1);
+			td.m_textBufferOffset = offset;
+		}
+		m_activeTextLayers[activeTextCount++] = i;
 	}
+	m_activeTextLayers.resize(activeTextCount);
 	m_textDrawLists.clear();
-	m_textBuffer.clear();
+	resetFrameArena(); // after reading m_textBuffer
+	if (isFrameArenaEnabled())
+	{
+		m_textBuffer.clear();
+		m_textBuffer.append(textBuffer);
+	}
+	else
+	{
+		Vector<char>::swap(m_textBuffer, textBuffer);
+	}
+
+ // GC is amortized over m_layerMaxUnusedFrames, layers are freed after between N and 2N unused frames
+	if (m_appData.m_layerMaxUnusedFrames > 0 && (m_frameIndex % m_appData.m_layerMaxUnusedFrames) == 0)
+	{
+		collectLayers();
+	}
+	updateLayerState();
 
 	m_sortCalled = false;
 	m_endFrameCalled = false;
@@ -1727,98 +2645,467 @@ void Context::reset()
 
 void Context::merge(const Context& _src)
 {
-	IM3D_ASSERT(!m_endFrameCalled && !_src.m_endFrameCalled); // call MergeContexts() before calling EndFrame()
+	const Context* src = &_src;
+	merge(&src, 1);
+}
+
+void Context::merge(const Context* const* _srcs, U32 _count)
+{
+	IM3D_ASSERT(!m_endFrameCalled); // call MergeContexts() before calling EndFrame()
 
  // layer IDs
-	for (Id id : _src.m_layerIdMap)
+	for (U32 s = 0; s < _count; ++s)
 	{
-		pushLayerId(id); // add a new layer if id doesn't alrady exist
-		popLayerId();
+		IM3D_ASSERT(!_srcs[s]->m_endFrameCalled);
+		for (Id id : _srcs[s]->m_layerIdMap)
+		{
+			pushLayerId(id); // add a new layer if id doesn't alrady exist
+			popLayerId();
+		}
 	}
 
- // vertex data
-	for (U32 i = 0; i < 2; ++i)
+ // count the data to copy into each list
+	const U32 listCount = m_vertexData[0].size();
+	m_mergeLists.clear();
+	m_mergeLists.resize(listCount * 2, MergeList());
+	for (U32 s = 0; s < _count; ++s)
 	{
-		const auto& vertexData = _src.m_vertexData[i];
-		for (U32 j = 0; j < vertexData.size(); ++j)
+		const Context& src = *_srcs[s];
+		for (int i = 0; i < 2; ++i)
 		{
-		 // for each layer in _src, find the matching layer in this
-			const Id layerId = _src.m_layerIdMap[j / DrawPrimitive_Count];
-			const int layerIndex = findLayerIndex(layerId);
-			IM3D_ASSERT(layerIndex >= 0);
-			U32 k = j % DrawPrimitive_Count;
-			m_vertexData[i][layerIndex * DrawPrimitive_Count + k]->append(*vertexData[j]);
+			for (U32 j : src.m_activeLists[i])
+			{
+				const int dstList = findMergeList(src, j);
+				if (dstList < 0)
+				{
+					continue;
+				}
+				MergeList& mergeList = m_mergeLists[i * listCount + dstList];
+				for (U32 page = 0; page < src.getPageCount(i, j); ++page)
+				{
+					const VertexList& srcVertexData = src.getPageVertexList(i, j, page);
+					if (!isMergeLinked(i, dstList, srcVertexData))
+					{
+						mergeList.m_vertexCount += srcVertexData.size();
+						#if IM3D_INDEXED_DRAW_LISTS
+							mergeList.m_indexCount += src.getPageIndexList(i, j, page).size();
+						#endif
+					}
+				}
+			}
 		}
 	}
 
- // text data
-	for (U32 i = 0; i < _src.m_textData.size(); ++i)
+ // size the lists and record the copies (linked pages are added directly)
+	m_mergeCopies.clear();
+	m_mergeTasks.clear();
+	for (U32 s = 0; s < _count; ++s)
 	{
-		const Id layerId = _src.m_layerIdMap[i];
-		const int layerIndex = findLayerIndex(layerId);
-		IM3D_ASSERT(layerIndex >= 0);
-
-		const U32 textBufferOffset = m_textBuffer.size();
-		m_textBuffer.append(_src.m_textBuffer);
-		const auto& textList = _src.m_textData[i];
-		for (U32 j = 0; j < textList->size(); ++j)
+		const Context& src = *_srcs[s];
+		m_mergeTasks.push_back(m_mergeCopies.size());
+		for (int i = 0; i < 2; ++i)
 		{
-			m_textData[i]->push_back((*_src.m_textData[i])[j]);
-			m_textData[i]->back().m_textBufferOffset += textBufferOffset;
+			for (U32 j : src.m_activeLists[i])
+			{
+				const int dstList = findMergeList(src, j);
+				if (dstList < 0)
+				{
+					continue;
+				}
+				markListActive(i, dstList);
+				MergeList& mergeList = m_mergeLists[i * listCount + dstList];
+				for (U32 page = 0; page < src.getPageCount(i, j); ++page)
+				{
+					const VertexList& srcVertexData = src.getPageVertexList(i, j, page);
+					#if IM3D_INDEXED_DRAW_LISTS
+						const IndexList& srcIndexData = src.getPageIndexList(i, j, page);
+						m_budgetStats.m_vertexCount += srcIndexData.size();
+					#else
+						m_budgetStats.m_vertexCount += srcVertexData.size();
+					#endif
+					if (srcVertexData.empty())
+					{
+						continue;
+					}
+					if (isMergeLinked(i, dstList, srcVertexData))
+					{
+						#if IM3D_INDEXED_DRAW_LISTS
+							linkPage(dstList, srcVertexData, srcIndexData);
+						#else
+							linkPage(dstList, srcVertexData);
+						#endif
+						continue;
+					}
+					if (i == 1)
+					{
+						#if IM3D_INDEXED_DRAW_LISTS
+							mergeSortRun(src, j, dstList, m_indexData[1][dstList]->size());
+						#else
+							mergeSortRun(src, j, dstList, m_vertexData[1][dstList]->size());
+						#endif
+					}
+					if (!mergeList.m_touched)
+					{
+					 // all sources go to the same page (the list doesn't grow after being sized), seal the existing data if they don't fit with it
+						if (i == 0 && m_appData.m_vertexPageSize)
+						{
+							#if IM3D_INDEXED_DRAW_LISTS
+								sealPage(dstList, mergeList.m_indexCount);
+							#else
+								sealPage(dstList, mergeList.m_vertexCount);
+							#endif
+						}
+						mergeList.m_touched = true;
+					}
+
+				 // reserve everything left to copy, a no-op unless linkPage() sealed the list: copies point into the list so it mustn't move
+					VertexList& dstVertexData = *m_vertexData[i][dstList];
+					dstVertexData.reserve(dstVertexData.size() + mergeList.m_vertexCount);
+					MergeCopy copy;
+					copy.m_src = srcVertexData.data();
+					copy.m_dst = dstVertexData.data() + dstVertexData.size();
+					copy.m_count = srcVertexData.size();
+					#if IM3D_INDEXED_DRAW_LISTS
+						IndexList& dstIndexData = *m_indexData[i][dstList];
+						dstIndexData.reserve(dstIndexData.size() + mergeList.m_indexCount);
+						copy.m_srcIndices = srcIndexData.data();
+						copy.m_dstIndices = dstIndexData.data() + dstIndexData.size();
+						copy.m_indexCount = srcIndexData.size();
+						copy.m_indexOffset = dstVertexData.size(); // rebase indices to the end of the destination vertex data
+						dstIndexData.resize(dstIndexData.size() + copy.m_indexCount);
+						mergeList.m_indexCount -= copy.m_indexCount;
+					#endif
+					dstVertexData.resize(dstVertexData.size() + copy.m_count);
+					mergeList.m_vertexCount -= copy.m_count;
+					m_mergeCopies.push_back(copy);
+				}
+			}
 		}
 	}
-}
-
-void Context::endFrame()
-{
-	IM3D_ASSERT(!m_endFrameCalled); // EndFrame() was called multiple times for this frame
-	m_endFrameCalled = true;
+	m_mergeTasks.push_back(m_mergeCopies.size());
 
- // draw unsorted primitives first
-	for (U32 i = 0; i < m_vertexData[0].size(); ++i)
+ // copy vertex data, one task per source
+	if (m_appData.parallelForCallback && _count > 1)
 	{
-		if (m_vertexData[0][i]->size() > 0)
+		m_appData.parallelForCallback(_count, MergeTask, this);
+	}
+	else
+	{
+		for (U32 s = 0; s < _count; ++s)
 		{
-			DrawList& dl     = m_drawLists.push_back();
-			dl.m_layerId     = m_layerIdMap[i / DrawPrimitive_Count];
-			dl.m_primType    = (DrawPrimitiveType)(i % DrawPrimitive_Count);
-			dl.m_vertexData  = m_vertexData[0][i]->data();
-			dl.m_vertexCount = m_vertexData[0][i]->size();
+			MergeTask(s, this);
 		}
 	}
 
- // draw sorted primitives second
-	if (!m_sortCalled)
+ // text data, only the text of merged layers is copied (the source buffer may also contain retained or skipped text)
+	U32 textBufferSize = m_textBuffer.size();
+	for (U32 s = 0; s < _count; ++s)
 	{
-		sort();
+		const Context& src = *_srcs[s];
+		for (U32 i : src.m_activeTextLayers)
+		{
+			if (findMergeLayer(src, i) >= 0)
+			{
+				for (const TextData& td : *src.m_textData[i])
+				{
+					textBufferSize += td.m_textLength + 1;
+				}
+			}
+		}
 	}
-
-	for (U32 i = 0; i < m_textData.size(); ++i) {
-		if (m_textData[i]->size() > 0)
+	m_textBuffer.reserve(textBufferSize);
+	for (U32 s = 0; s < _count; ++s)
+	{
+		const Context& src = *_srcs[s];
+		for (U32 i : src.m_activeTextLayers)
 		{
-			TextDrawList& dl   = m_textDrawLists.push_back();
-			dl.m_layerId       = m_layerIdMap[i];
-			dl.m_textData      = m_textData[i]->data();
-			dl.m_textDataCount = m_textData[i]->size();
-			dl.m_textBuffer    = m_textBuffer.data();
+			const int layerIndex = findMergeLayer(src, i);
+			if (layerIndex < 0)
+			{
+				continue;
+			}
+			markTextActive(layerIndex);
+			TextList& textList = *m_textData[layerIndex];
+			for (const TextData& td : *src.m_textData[i])
+			{
+				textList.push_back(td);
+				textList.back().m_textBufferOffset = m_textBuffer.size();
+				m_textBuffer.append(src.m_textBuffer.data() + td.m_textBufferOffset, td.m_textLength + 1);
+			}
+			m_budgetStats.m_textBytes += src.m_layerLists[i]->m_textBytes;
+			m_layerLists[layerIndex]->m_textBytes += src.m_layerLists[i]->m_textBytes;
 		}
 	}
 }
 
-void Context::draw()
+void Context::endFrame()
 {
-	if (m_drawLists.empty())
+	IM3D_ASSERT(!m_endFrameCalled); // EndFrame() was called multiple times for this frame
+	m_endFrameCalled = true;
+	sortActiveLists();
+
+ // linked data is only valid for this frame (see AppData::m_mergeLinked), retained layers must own it
+	for (U32 i : m_activeLists[0])
 	{
-		endFrame();
+		if (m_layerFlags[i / DrawPrimitive_Count] & LayerFlags_Retained)
+		{
+			unlinkPages(i);
+		}
 	}
 
-	IM3D_ASSERT(m_appData.drawCallback);
+ // trim keep-nearest budgets, during the frame they may exceed the limit (see updatePrimBudget())
+	for (U32 i = 0; i < 2; ++i)
+	{
+		for (U32 j = 0; j < m_activeLists[i].size(); ++j)
+		{
+			const U32 layer = m_activeLists[i][j] / DrawPrimitive_Count;
+			if (j > 0 && m_activeLists[i][j - 1] / DrawPrimitive_Count == layer)
+			{
+				continue;
+			}
+			const Budget& budget = m_layerLists[layer]->m_budget;
+			if ((m_layerFlags[layer] & (LayerFlags_Budget | LayerFlags_Recorded)) == LayerFlags_Budget && budget.m_policy == BudgetPolicy_KeepNearest && budget.m_maxVertices && getLayerVertexCount(layer) > budget.m_maxVertices)
+			{
+				keepNearest((int)layer, budget.m_maxVertices);
+			}
+		}
+	}
+	if (m_appData.m_budget.m_policy == BudgetPolicy_KeepNearest && m_appData.m_budget.m_maxVertices && m_budgetStats.m_vertexCount > m_appData.m_budget.m_maxVertices)
+	{
+		keepNearest(-1, m_appData.m_budget.m_maxVertices);
+	}
+
+	if (m_frameDataPacked)
+	{
+	 // allocate the frame data up front so that draw lists can point into it, packing happens after sorting
+		const U32 alignment = m_appData.m_drawDataAlignment ? m_appData.m_drawDataAlignment : 1;
+		IM3D_ASSERT((alignment & (alignment - 1)) == 0); // m_drawDataAlignment must be a power of 2
+	 // alignment in elements, = alignment / the largest power of 2 which divides the element size
+		const U32 vertexSizeAlignment = (U32)(sizeof(DrawVertexData) & (~sizeof(DrawVertexData) + 1));
+		const U32 vertexAlignment = alignment > vertexSizeAlignment ? alignment / vertexSizeAlignment : 1;
+		U32 vertexCount = 0;
+		#if IM3D_INDEXED_DRAW_LISTS
+			const U32 indexAlignment = alignment > sizeof(U32) ? alignment / (U32)sizeof(U32) : 1;
+			U32 indexCount = 0;
+		#endif
+	 // only active lists are written, offsets for inactive lists are never read
+		m_frameVertexOffsets.resize(m_vertexData[0].size() * 2);
+		#if IM3D_INDEXED_DRAW_LISTS
+			m_frameIndexOffsets.resize(m_vertexData[0].size() * 2);
+		#endif
+		for (U32 i = 0; i < 2; ++i)
+		{
+			for (U32 j : m_activeLists[i])
+			{
+			 // pages are packed consecutively (see packFrameData())
+				U32 listVertexCount = 0;
+				#if IM3D_INDEXED_DRAW_LISTS
+					U32 listIndexCount = 0;
+				#endif
+				for (U32 page = 0; page < getPageCount(i, j); ++page)
+				{
+					listVertexCount += getPageVertexList(i, j, page).size();
+					#if IM3D_INDEXED_DRAW_LISTS
+						listIndexCount += getPageIndexList(i, j, page).size();
+					#endif
+				}
+				if (listVertexCount > 0)
+				{
+					vertexCount = (vertexCount + vertexAlignment - 1) & ~(vertexAlignment - 1);
+				}
+				m_frameVertexOffsets[i * m_vertexData[0].size() + j] = vertexCount;
+				vertexCount += listVertexCount;
+				#if IM3D_INDEXED_DRAW_LISTS
+					if (listIndexCount > 0)
+					{
+						indexCount = (indexCount + indexAlignment - 1) & ~(indexAlignment - 1);
+					}
+					m_frameIndexOffsets[i * m_vertexData[0].size() + j] = indexCount;
+					indexCount += listIndexCount;
+				#endif
+			}
+		}
+		m_frameVertexData.resize(vertexCount);
+		#if IM3D_INDEXED_DRAW_LISTS
+			m_frameIndexData.resize(indexCount);
+		#endif
+	}
+
+ // draw unsorted primitives first
+	for (U32 i : m_activeLists[0])
+	{
+		if (isLayerHidden(m_layerFlags[i / DrawPrimitive_Count]))
+		{
+			continue; // disabled layers still draw data recorded this frame, only retained data is hidden
+		}
+	 // packed pages are contiguous, else one draw list per page
+		const U32 pageCount = getPageCount(0, i);
+		for (U32 page = 0; page < pageCount; ++page)
+		{
+			const VertexList& vertexList = getPageVertexList(0, i, page);
+			if (vertexList.empty() && !m_frameDataPacked)
+			{
+				continue;
+			}
+			if (m_frameDataPacked && page > 0)
+			{
+				DrawList& dl = m_drawLists.back();
+				dl.m_vertexCount += vertexList.size();
+				#if IM3D_INDEXED_DRAW_LISTS
+					dl.m_indexCount += getPageIndexList(0, i, page).size();
+				#endif
+				continue;
+			}
+			DrawList& dl     = m_drawLists.push_back();
+			dl.m_layerId     = m_layerIdMap[i / DrawPrimitive_Count];
+			dl.m_primType    = (DrawPrimitiveType)(i % DrawPrimitive_Count);
+			dl.m_vertexData   = m_frameDataPacked ? getDrawVertexData(0, i) : (const DrawVertexData*)vertexList.data();
+			dl.m_vertexCount  = vertexList.size();
+			dl.m_vertexOffset = getFrameVertexOffset(0, i);
+			#if IM3D_INDEXED_DRAW_LISTS
+				dl.m_indexData    = m_frameDataPacked ? getDrawIndexData(0, i) : getPageIndexList(0, i, page).data();
+				dl.m_indexCount   = getPageIndexList(0, i, page).size();
+				dl.m_indexOffset  = getFrameIndexOffset(0, i);
+			#else
+				dl.m_indexData    = nullptr;
+				dl.m_indexCount   = 0;
+				dl.m_indexOffset  = 0;
+			#endif
+		}
+		if (m_frameDataPacked && m_drawLists.back().m_vertexCount == 0)
+		{
+			m_drawLists.pop_back();
+		}
+	}
+
+ // draw sorted primitives second
+	if (!m_sortCalled)
+	{
+		sort();
+	}
+
+	if (m_frameDataPacked)
+	{
+		packFrameData();
+	}
+
+	if (m_vertexStorage.m_commit)
+	{
+		if (m_frameVertexData.isExternal())
+		{
+			m_vertexStorage.m_commit(m_frameVertexData.data(), sizeof(DrawVertexData) * m_frameVertexData.size(), m_vertexStorage.m_userData);
+		}
+		for (U32 i = 0; i < 2; ++i)
+		{
+			for (U32 j : m_activeLists[i])
+			{
+				for (U32 page = 0; page < getPageCount(i, j); ++page)
+				{
+					VertexList& vertexList = getPageVertexList(i, j, page);
+					if (vertexList.isExternal() && !vertexList.empty() && !isPageLinked(i, j, page))
+					{
+						m_vertexStorage.m_commit(vertexList.data(), sizeof(VertexData) * vertexList.size(), m_vertexStorage.m_userData);
+					}
+				}
+			}
+		}
+	}
+
+	for (U32 i : m_activeTextLayers) {
+		if (m_textData[i]->size() > 0 && !isLayerHidden(m_layerFlags[i]))
+		{
+			TextDrawList& dl   = m_textDrawLists.push_back();
+			dl.m_layerId       = m_layerIdMap[i];
+			dl.m_textData      = m_textData[i]->data();
+			dl.m_textDataCount = m_textData[i]->size();
+			dl.m_textBuffer    = m_textBuffer.data();
+		}
+	}
+
+	if (m_appData.m_frameSnapshots)
+	{
+	 // the per-layer text lists change during the next frame, copy them to m_frameTextData
+		for (const TextDrawList& dl : m_textDrawLists)
+		{
+			m_frameTextData.append(dl.m_textData, dl.m_textDataCount);
+		}
+		U32 textOffset = 0;
+		for (TextDrawList& dl : m_textDrawLists)
+		{
+			dl.m_textData = m_frameTextData.data() + textOffset;
+			textOffset += dl.m_textDataCount;
+		}
+		publishFrameSnapshot();
+	}
+}
+
+void Context::draw()
+{
+	if (m_drawLists.empty())
+	{
+		endFrame();
+	}
+
+	IM3D_ASSERT(m_appData.drawCallback);
 	for (auto& drawList : m_drawLists)
 	{
 		m_appData.drawCallback(drawList);
 	}
 }
 
+void Context::publishFrameSnapshot()
+{
+	FrameSnapshots& snapshots = *m_frameSnapshots;
+	FrameSnapshots::Slot& slot = snapshots.m_slots[snapshots.m_back];
+	Vector<DrawList>::swap(slot.m_drawLists, m_drawLists);
+	Vector<TextDrawList>::swap(slot.m_textDrawLists, m_textDrawLists);
+	Vector<TextData>::swap(slot.m_textData, m_frameTextData);
+	Vector<char>::swap(slot.m_textBuffer, m_textBuffer);
+	Vector<DrawVertexData>::swap(slot.m_vertexData, m_frameVertexData);
+	#if IM3D_INDEXED_DRAW_LISTS
+		Vector<U32>::swap(slot.m_indexData, m_frameIndexData);
+	#else
+		Vector<U32>::swap(slot.m_indexData, m_sortedIndexData);
+	#endif
+
+	FrameSnapshot& snapshot      = slot.m_snapshot;
+	snapshot.m_drawLists         = slot.m_drawLists.data();
+	snapshot.m_drawListCount     = slot.m_drawLists.size();
+	snapshot.m_textDrawLists     = slot.m_textDrawLists.data();
+	snapshot.m_textDrawListCount = slot.m_textDrawLists.size();
+	snapshot.m_vertexData        = slot.m_vertexData.empty() ? nullptr : slot.m_vertexData.data();
+	snapshot.m_vertexCount       = slot.m_vertexData.size();
+	snapshot.m_indexData         = slot.m_indexData.empty() ? nullptr : slot.m_indexData.data();
+	snapshot.m_indexCount        = slot.m_indexData.size();
+	snapshot.m_frameIndex        = m_frameIndex;
+	slot.m_published             = true;
+	snapshots.m_lastTextBuffer   = &slot.m_textBuffer;
+	snapshots.m_back = snapshots.m_middle.exchange(snapshots.m_back | FrameSnapshots::kFresh, std::memory_order_acq_rel) & ~FrameSnapshots::kFresh;
+
+ // the context now holds the buffers of an older snapshot, which the consumer has released
+	m_drawLists.clear();
+	m_textDrawLists.clear();
+	m_frameTextData.clear();
+	m_textBuffer.clear();
+	m_frameVertexData.clear();
+	#if IM3D_INDEXED_DRAW_LISTS
+		m_frameIndexData.clear();
+	#else
+		m_sortedIndexData.clear();
+	#endif
+}
+
+const FrameSnapshot* Context::acquireFrameSnapshot()
+{
+	FrameSnapshots& snapshots = *m_frameSnapshots;
+	if (snapshots.m_middle.load(std::memory_order_relaxed) & FrameSnapshots::kFresh)
+	{
+		snapshots.m_front = snapshots.m_middle.exchange(snapshots.m_front, std::memory_order_acq_rel) & ~FrameSnapshots::kFresh;
+	}
+	const FrameSnapshots::Slot& slot = snapshots.m_slots[snapshots.m_front];
+	return slot.m_published ? &slot.m_snapshot : nullptr;
+}
+
 void Context::pushEnableSorting(bool _enable)
 {
 	IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change sort mode mid-primitive
@@ -1846,244 +3133,1913 @@ void Context::pushLayerId(Id _layer)
 	{
 		idx = m_layerIdMap.size();
 		m_layerIdMap.push_back(_layer);
+		insertLayerIndex(_layer, idx);
+
+	 // allocate a new block of layer storage if required
+		if (m_layerListsFree.empty())
+		{
+			LayerLists* block = (LayerLists*)AlignedMalloc(sizeof(LayerLists) * kLayerBlockSize, alignof(LayerLists), &m_allocator);
+			for (U32 i = 0; i < kLayerBlockSize; ++i)
+			{
+				block[i] = LayerLists();
+				block[i].setAllocator(&m_allocator);
+				m_layerListsFree.push_back(&block[kLayerBlockSize - i - 1]); // pop from the front of the block first
+			}
+			m_layerBlocks.push_back(block);
+		}
+		LayerLists& layerLists = *m_layerListsFree.back();
+		m_layerListsFree.pop_back();
+		m_layerLists.push_back(&layerLists);
+		layerLists.m_budget = Budget();
+		layerLists.m_textBytes = 0;
+
 		for (int i = 0; i < DrawPrimitive_Count; ++i)
 		{
-			m_vertexData[0].push_back((VertexList*)IM3D_MALLOC(sizeof(VertexList)));
-			*m_vertexData[0].back() = VertexList();
-			m_vertexData[1].push_back((VertexList*)IM3D_MALLOC(sizeof(VertexList)));
-			*m_vertexData[1].back() = VertexList();
+			for (int j = 0; j < 2; ++j)
+			{
+				m_vertexData[j].push_back(&layerLists.m_vertexData[j][i]);
+				m_vertexData[j].back()->setStorage(m_frameDataPacked ? nullptr : &m_vertexStorage); // see reset()
+				m_listActive[j].push_back(false);
+				#if IM3D_INDEXED_DRAW_LISTS
+					m_indexData[j].push_back(&layerLists.m_indexData[j][i]);
+				#endif
+			}
+			m_sortOrder.push_back(&layerLists.m_sortOrder[i]);
+			m_listState.push_back(nullptr);
+		}
+		m_textData.push_back(&layerLists.m_textData);
+		m_layerFlags.push_back(0);
+		m_layerLastUsed.push_back(m_frameIndex);
+	}
+	m_layerIdStack.push_back(_layer);
+	m_layerIndex = idx;
+	if ((m_layerFlags[idx] & LayerFlags_Used) == 0)
+	{
+		m_layerFlags[idx] |= LayerFlags_Used;
+		m_usedLayers.push_back(idx);
+	}
+	updateLayerState();
+}
+void Context::popLayerId()
+{
+	IM3D_ASSERT(m_layerIdStack.size() > 1);
+	m_layerIdStack.pop_back();
+	m_layerIndex = findLayerIndex(m_layerIdStack.back());
+	updateLayerState();
+}
+void Context::setLayerEnabled(Id _layer, bool _enable)
+{
+	IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change layer state mid-primitive
+	U32& flags = m_layerFlags[findOrAddLayerIndex(_layer)];
+	flags = _enable ? (flags & ~LayerFlags_Disabled) : (flags | LayerFlags_Disabled);
+	updateLayerState();
+}
+void Context::setLayerBudget(Id _layer, const Budget& _budget)
+{
+	IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change layer state mid-primitive
+	const U32 idx = findOrAddLayerIndex(_layer);
+	m_layerLists[idx]->m_budget = _budget;
+	U32& flags = m_layerFlags[idx];
+	flags = (_budget.m_maxVertices || _budget.m_maxTextBytes) ? (flags | LayerFlags_Budget) : (flags & ~LayerFlags_Budget);
+}
+bool Context::isLayerEnabled(Id _layer) const
+{
+	int idx = findLayerIndex(_layer);
+	return idx == -1 || (m_layerFlags[idx] & LayerFlags_Disabled) == 0;
+}
+void Context::setLayerRetained(Id _layer, bool _retain)
+{
+	IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change layer state mid-primitive
+	if (!_retain)
+	{
+		invalidateLayer(_layer);
+	}
+	U32& flags = m_layerFlags[findOrAddLayerIndex(_layer)];
+	flags = _retain ? (flags | LayerFlags_Retained) : (flags & ~LayerFlags_Retained);
+	updateLayerState();
+}
+void Context::invalidateLayer(Id _layer)
+{
+	IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change layer state mid-primitive
+	int idx = findLayerIndex(_layer);
+	if (idx == -1 || (m_layerFlags[idx] & LayerFlags_Recorded) == 0)
+	{
+		return; // nothing retained, any data recorded this frame is kept
+	}
+	for (int i = 0; i < DrawPrimitive_Count; ++i)
+	{
+		const U32 list = idx * DrawPrimitive_Count + i;
+		releasePages(list);
+		for (int j = 0; j < 2; ++j)
+		{
+			m_vertexData[j][list]->clear();
+			m_vertexData[j][list]->setStorage(m_frameDataPacked ? nullptr : &m_vertexStorage);
+			#if IM3D_INDEXED_DRAW_LISTS
+				m_indexData[j][list]->clear();
+			#endif
+		}
+		m_sortOrder[list]->clear();
+		clearSortKeys(list);
+	}
+	m_textData[idx]->clear(); // text is removed from m_textBuffer during the next reset()
+	m_layerFlags[idx] &= ~LayerFlags_Recorded;
+	updateLayerState();
+}
+
+namespace {
+	struct SortData
+	{
+		float       m_key;
+		U32         m_start; // offset of the primitive's first vertex (or index) in the list
+		SortData() {}
+		SortData(float _key, U32 _start): m_key(_key), m_start(_start) {}
+	};
+}
+
+struct Context::SortScratch
+{
+	Vector<SortData>    m_sortData[DrawPrimitive_Count + 1]; // +1 for the radix sort scratch buffer
+	#if IM3D_INDEXED_DRAW_LISTS
+	Vector<U32>         m_reorder;
+	#else
+	Vector<VertexData>  m_reorder;
+	#endif
+	Vector<bool>        m_keep;    // per primitive, see keepNearest()
+	Vector<U32>         m_runEnds; // see MergeRuns()
+};
+
+Context::Context()
+	: Context(Allocator())
+{
+}
+
+Context::Context(const Allocator& _allocator)
+{
+	#if IM3D_ALLOC_TRACKING
+	 // count allocations then forward to the app allocator
+		m_appAllocator = _allocator;
+		m_allocator.m_allocate = &TrackedAllocate;
+		m_allocator.m_free = &TrackedFree;
+		m_allocator.m_userData = this;
+	#else
+		m_allocator = _allocator;
+	#endif
+	m_colorStack.setAllocator(&m_allocator);
+	m_alphaStack.setAllocator(&m_allocator);
+	m_sizeStack.setAllocator(&m_allocator);
+	m_enableSortingStack.setAllocator(&m_allocator);
+	m_matrixStack.setAllocator(&m_allocator);
+	m_idStack.setAllocator(&m_allocator);
+	m_layerIdStack.setAllocator(&m_allocator);
+	for (int i = 0; i < 2; ++i)
+	{
+		m_vertexData[i].setAllocator(&m_allocator);
+		#if IM3D_INDEXED_DRAW_LISTS
+			m_indexData[i].setAllocator(&m_allocator);
+		#endif
+		m_activeLists[i].setAllocator(&m_allocator);
+		m_listActive[i].setAllocator(&m_allocator);
+	}
+	m_sortOrder.setAllocator(&m_allocator);
+	m_listState.setAllocator(&m_allocator);
+	m_listStateFree.setAllocator(&m_allocator);
+	m_layerIdMap.setAllocator(&m_allocator);
+	m_layerIdHash.setAllocator(&m_allocator);
+	m_layerFlags.setAllocator(&m_allocator);
+	m_drawLists.setAllocator(&m_allocator);
+	m_frameVertexData.setAllocator(&m_allocator);
+	m_frameVertexOffsets.setAllocator(&m_allocator);
+	#if IM3D_INDEXED_DRAW_LISTS
+		m_frameIndexData.setAllocator(&m_allocator);
+		m_frameIndexOffsets.setAllocator(&m_allocator);
+	#else
+		m_sortedIndexData.setAllocator(&m_allocator);
+	#endif
+	m_textData.setAllocator(&m_allocator);
+	m_activeTextLayers.setAllocator(&m_allocator);
+	m_textBuffer.setAllocator(&m_allocator);
+	m_textDrawLists.setAllocator(&m_allocator);
+	m_layerBlocks.setAllocator(&m_allocator);
+	m_layerLists.setAllocator(&m_allocator);
+	m_layerListsFree.setAllocator(&m_allocator);
+	m_layerLastUsed.setAllocator(&m_allocator);
+	m_usedLayers.setAllocator(&m_allocator);
+	m_droppedLayers.setAllocator(&m_allocator);
+	m_vertexPagesFree.setAllocator(&m_allocator);
+	m_linkedPagesFree.setAllocator(&m_allocator);
+	m_mergeLists.setAllocator(&m_allocator);
+	m_mergeCopies.setAllocator(&m_allocator);
+	m_mergeTasks.setAllocator(&m_allocator);
+	m_textBufferScratch.setAllocator(&m_allocator);
+	m_frameTextData.setAllocator(&m_allocator);
+	m_sortScratch = nullptr;
+	m_frameSnapshots = new(AlignedMalloc(sizeof(FrameSnapshots), alignof(FrameSnapshots), &m_allocator)) FrameSnapshots();
+	for (FrameSnapshots::Slot& slot : m_frameSnapshots->m_slots)
+	{
+		slot.m_drawLists.setAllocator(&m_allocator);
+		slot.m_textDrawLists.setAllocator(&m_allocator);
+		slot.m_textData.setAllocator(&m_allocator);
+		slot.m_textBuffer.setAllocator(&m_allocator);
+		slot.m_vertexData.setAllocator(&m_allocator);
+		slot.m_indexData.setAllocator(&m_allocator);
+	}
+
+	m_frameArenaStorage.m_allocate = &FrameArenaAllocate;
+	m_frameArenaStorage.m_grow = &FrameArenaGrow;
+	m_frameArenaStorage.m_userData = this;
+	m_frameArena = nullptr;
+	m_frameArenaSize = 0;
+	m_frameArenaUsed = 0;
+	m_frameArenaLast = 0;
+	m_frameArenaRequired = 0;
+
+	m_sortCalled = false;
+	m_endFrameCalled = false;
+	m_primMode = PrimitiveMode_None;
+	m_vertexDataIndex = 0; // = sorting disabled
+	m_layerIndex = 0;
+	m_layerRecording = true;
+	m_layerRetained = false;
+	m_frameIndex = 0;
+	m_presortOrigin = Vec3(0.0f);
+	m_firstVertThisPrim = 0;
+	m_vertCountThisPrim = 0;
+	#if IM3D_INDEXED_DRAW_LISTS
+		m_firstIndexThisPrim = 0;
+	#endif
+	m_primVertexBudget = ~0u;
+	m_primBudgetLayer = false;
+	m_primPageSize = ~0u;
+	m_frameDataPacked = IM3D_VERTEX_COMPACT;
+	m_frameVertexData.setStorage(&m_vertexStorage);
+
+	m_gizmoLocal = false;
+	m_gizmoMode = GizmoMode_Translation;
+	m_hotId = Id_Invalid;
+	m_activeId = Id_Invalid;
+	m_appId = Id_Invalid;
+	m_appActiveId = Id_Invalid;
+	m_appHotId = Id_Invalid;
+	m_hotDepth = FLT_MAX;
+	m_gizmoHeightPixels = 64.0f;
+	m_gizmoSizePixels = 5.0f;
+
+	memset(&m_keyDownCurr, 0, sizeof(m_keyDownCurr));
+	memset(&m_keyDownPrev, 0, sizeof(m_keyDownPrev));
+
+ // init cull frustum to INF effectively disables culling
+	for (int i = 0; i < FrustumPlane_Count; ++i)
+	{
+		m_appData.m_cullFrustum[i] = Vec4(INFINITY);
+	}
+
+	pushMatrix(Mat4(1.0f));
+	pushColor(Color_White);
+	pushAlpha(1.0f);
+	pushSize(1.0f);
+	pushEnableSorting(false);
+	pushLayerId(0);
+	pushId(0x811C9DC5u); // fnv1 hash base
+}
+
+Context::~Context()
+{
+	for (U32 i = 0; i < m_vertexData[0].size(); ++i)
+	{
+		releasePages(i);
+		if (m_listState[i])
+		{
+			m_listStateFree.push_back(m_listState[i]);
+		}
+	}
+	for (ListState* listState : m_listStateFree)
+	{
+		listState->~ListState();
+		AlignedFree(listState, &m_allocator);
+	}
+	for (VertexPage* page : m_vertexPagesFree)
+	{
+		page->~VertexPage();
+		AlignedFree(page, &m_allocator);
+	}
+	for (VertexPage* page : m_linkedPagesFree)
+	{
+		page->~VertexPage();
+		AlignedFree(page, &m_allocator);
+	}
+	while (!m_layerBlocks.empty())
+	{
+		LayerLists* block = m_layerBlocks.back();
+		for (U32 i = 0; i < kLayerBlockSize; ++i)
+		{
+			block[i].~LayerLists(); // manually call dtor (block is allocated via AlignedMalloc during pushLayerId)
+		}
+		AlignedFree(block, &m_allocator);
+		m_layerBlocks.pop_back();
+	}
+	if (m_frameArena)
+	{
+		AlignedFree(m_frameArena, &m_allocator);
+	}
+	if (m_sortScratch)
+	{
+		m_sortScratch->~SortScratch();
+		AlignedFree(m_sortScratch, &m_allocator);
+	}
+	m_frameSnapshots->~FrameSnapshots();
+	AlignedFree(m_frameSnapshots, &m_allocator);
+}
+
+void Context::LayerLists::setAllocator(const Allocator* _allocator)
+{
+	for (int i = 0; i < DrawPrimitive_Count; ++i)
+	{
+		for (int j = 0; j < 2; ++j)
+		{
+			m_vertexData[j][i].setAllocator(_allocator);
+			#if IM3D_INDEXED_DRAW_LISTS
+				m_indexData[j][i].setAllocator(_allocator);
+			#endif
+		}
+		m_sortOrder[i].setAllocator(_allocator);
+	}
+	m_textData.setAllocator(_allocator);
+}
+
+namespace {
+	// Map _key to a U32 whose integer order is the reverse of the float order (sort back to front).
+	inline U32 SortKey(float _key)
+	{
+		U32 u;
+		memcpy(&u, &_key, sizeof(U32));
+		u ^= (0u - (u >> 31)) | 0x80000000u; // flip all bits if negative, else flip the sign bit
+		return ~u;
+	}
+
+	// Stable LSD radix sort (8 bits per pass) of _data_ by descending key, _scratch_ is used as the second buffer.
+	void RadixSort(Vector<SortData>& _data_, Vector<SortData>& _scratch_)
+	{
+		const U32 count = _data_.size();
+		if (count < 2)
+		{
+			return;
+		}
+		_scratch_.clear();
+		_scratch_.resize(count);
+
+		U32 hist[4][256];
+		memset(hist, 0, sizeof(hist));
+		for (U32 i = 0; i < count; ++i)
+		{
+			const U32 key = SortKey(_data_[i].m_key);
+			++hist[0][key & 0xff];
+			++hist[1][(key >> 8) & 0xff];
+			++hist[2][(key >> 16) & 0xff];
+			++hist[3][key >> 24];
+		}
+
+		SortData* src = _data_.data();
+		SortData* dst = _scratch_.data();
+		for (U32 pass = 0; pass < 4; ++pass)
+		{
+			U32* h = hist[pass];
+			const U32 shift = pass * 8;
+			if (h[(SortKey(src[0].m_key) >> shift) & 0xff] == count)
+			{
+				continue; // all keys share this digit, skip the pass
+			}
+			U32 offset = 0;
+			for (U32 i = 0; i < 256; ++i)
+			{
+				const U32 n = h[i];
+				h[i] = offset;
+				offset += n;
+			}
+			for (U32 i = 0; i < count; ++i)
+			{
+				dst[h[(SortKey(src[i].m_key) >> shift) & 0xff]++] = src[i];
+			}
+			SortData* tmp = src;
+			src = dst;
+			dst = tmp;
+		}
+		if (src != _data_.data())
+		{
+			Vector<SortData>::swap(_data_, _scratch_);
+		}
+	}
+
+	// Stable insertion sort of _data_ by descending key, assuming that _data_ is almost sorted. Return false (leaving _data_
+	// partially sorted) if more than _maxMoves elements need to be moved.
+	bool InsertionSort(Vector<SortData>& _data_, U32 _maxMoves)
+	{
+		SortData* data = _data_.data();
+		U32 moves = 0;
+		for (U32 i = 1; i < _data_.size(); ++i)
+		{
+			const SortData d = data[i];
+			U32 j = i;
+			while (j > 0 && data[j - 1].m_key < d.m_key)
+			{
+				data[j] = data[j - 1];
+				--j;
+			}
+			data[j] = d;
+			moves += i - j;
+			if (moves > _maxMoves)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Stable merge of the runs of _data_ (each sorted by descending key) as RadixSort(), _runEnds_ is the end of each run
+	// and is overwritten. _scratch_ is used as the second buffer.
+	void MergeRuns(Vector<SortData>& _data_, Vector<SortData>& _scratch_, Vector<U32>& _runEnds_)
+	{
+		const U32 count = _data_.size();
+		U32 runCount = _runEnds_.size();
+		if (count < 2 || runCount < 2)
+		{
+			return;
+		}
+		_scratch_.clear();
+		_scratch_.resize(count);
+
+	 // merge pairs of adjacent runs until there is 1 run left
+		SortData* src = _data_.data();
+		SortData* dst = _scratch_.data();
+		while (runCount > 1)
+		{
+			U32 begin = 0;
+			U32 mergedCount = 0;
+			for (U32 r = 0; r < runCount; r += 2)
+			{
+				const U32 mid = _runEnds_[r];
+				const U32 end = r + 1 < runCount ? _runEnds_[r + 1] : mid;
+				U32 a = begin;
+				U32 b = mid;
+				U32 o = begin;
+				while (a < mid && b < end)
+				{
+				 // branchless, keys are usually in random order between runs; ties are taken from the first run
+					const bool takeB = src[b].m_key > src[a].m_key;
+					dst[o++] = takeB ? src[b] : src[a];
+					b += takeB;
+					a += !takeB;
+				}
+				while (a < mid)
+				{
+					dst[o++] = src[a++];
+				}
+				while (b < end)
+				{
+					dst[o++] = src[b++];
+				}
+				_runEnds_[mergedCount++] = end;
+				begin = end;
+			}
+			runCount = mergedCount;
+			SortData* tmp = src;
+			src = dst;
+			dst = tmp;
+		}
+		if (src != _data_.data())
+		{
+			Vector<SortData>::swap(_data_, _scratch_);
+		}
+	}
+
+	// Key each primitive of _vertexData (via _indexData if not null) by its midpoint distance to _viewOrigin, in list order.
+	void GetSortKeys(const VertexData* _vertexData, const U32* _indexData, U32 _elementCount, U32 _vertsPerPrim, const Vec3& _viewOrigin, Vector<SortData>& _sortData_)
+	{
+		_sortData_.clear();
+		_sortData_.reserve(_elementCount / _vertsPerPrim);
+		for (U32 e = 0; e < _elementCount; e += _vertsPerPrim)
+		{
+			_sortData_.push_back(SortData(0.0f, e));
+			IM3D_ASSERT(e + _vertsPerPrim <= _elementCount);
+			for (U32 j = 0; j < _vertsPerPrim; ++j)
+			{
+				const VertexData& v = _vertexData[_indexData ? _indexData[e + j] : e + j];
+			 // sort key is the primitive midpoint distance to view origin
+				_sortData_.back().m_key += Length2(Vec3(v.m_positionSize) - _viewOrigin);
+			}
+			_sortData_.back().m_key /= (float)_vertsPerPrim;
+		}
+	}
+
+	inline bool SameOrigin(const Vec3& _a, const Vec3& _b)
+	{
+		return _a.x == _b.x && _a.y == _b.y && _a.z == _b.z;
+	}
+
+	// Reorder the primitives in _data_ (vertices or indices) according to _sort.
+	template <typename T>
+	void Reorder(Vector<T>& _data_, Vector<T>& _scratch_, const SortData* _sort, U32 _sortCount, U32 _primSize)
+	{
+		_scratch_.clear();
+		_scratch_.resize(_sortCount * _primSize);
+		T* dst = _scratch_.data();
+		for (U32 i = 0; i < _sortCount; ++i)
+		{
+			memcpy(dst, _data_.data() + _sort[i].m_start, sizeof(T) * _primSize);
+			dst += _primSize;
+		}
+	 // copy rather than swap, swapping would trade _scratch_ for a smaller buffer and reallocate during the next frame
+		memcpy(_data_.data(), _scratch_.data(), sizeof(T) * _scratch_.size());
+	}
+}
+
+Context::SortScratch& Context::getSortScratch()
+{
+	if (!m_sortScratch)
+	{
+		m_sortScratch = (SortScratch*)AlignedMalloc(sizeof(SortScratch), alignof(SortScratch), &m_allocator);
+		*m_sortScratch = SortScratch();
+		for (Vector<SortData>& v : m_sortScratch->m_sortData)
+		{
+			v.setAllocator(&m_allocator);
+		}
+		m_sortScratch->m_reorder.setAllocator(&m_allocator);
+		m_sortScratch->m_keep.setAllocator(&m_allocator);
+		m_sortScratch->m_runEnds.setAllocator(&m_allocator);
+	}
+	return *m_sortScratch;
+}
+
+void Context::sort()
+{
+	Vector<SortData>* sortData = getSortScratch().m_sortData;
+	Vector<SortData>& sortScratch = sortData[DrawPrimitive_Count];
+
+ // reserve the largest list up front, the sort buffers are swapped between primitive types
+	U32 maxElementCount = 0;
+	U32 maxPrimCount = 0;
+	for (U32 i : m_activeLists[1])
+	{
+		#if IM3D_INDEXED_DRAW_LISTS
+			const U32 elementCount = m_indexData[1][i]->size();
+		#else
+			const U32 elementCount = m_vertexData[1][i]->size();
+		#endif
+		const U32 primCount = elementCount / VertsPerDrawPrimitive[i % DrawPrimitive_Count];
+		maxElementCount = elementCount > maxElementCount ? elementCount : maxElementCount;
+		maxPrimCount = primCount > maxPrimCount ? primCount : maxPrimCount;
+	}
+	for (int i = 0; i < DrawPrimitive_Count + 1; ++i)
+	{
+		sortData[i].reserve(maxPrimCount);
+	}
+	m_sortScratch->m_reorder.reserve(maxElementCount);
+
+	#if !IM3D_INDEXED_DRAW_LISTS
+	 // optionally output a permutation of the vertex data in m_sortedIndexData rather than reordering the vertex data
+		const bool sortIndexed = m_appData.m_sortIndexed;
+		U32 sortedIndexStart[DrawPrimitive_Count];
+		const U32 indexAlignment = (m_frameDataPacked && m_appData.m_drawDataAlignment > sizeof(U32)) ? m_appData.m_drawDataAlignment / (U32)sizeof(U32) : 1;
+		m_sortedIndexData.clear();
+		if (sortIndexed)
+		{
+		 // reserve the worst case up front, draw lists point into m_sortedIndexData
+			U32 sortedIndexCount = 0;
+			for (U32 i : m_activeLists[1])
+			{
+				sortedIndexCount += m_vertexData[1][i]->size() + indexAlignment - 1;
+			}
+			m_sortedIndexData.reserve(sortedIndexCount);
+		}
+	#endif
+
+ // m_activeLists is sorted (see endFrame()), visit each layer with active sorted lists once
+	for (U32 activeIndex = 0; activeIndex < m_activeLists[1].size(); ++activeIndex)
+	{
+		const U32 layer = m_activeLists[1][activeIndex] / DrawPrimitive_Count;
+		if (activeIndex > 0 && m_activeLists[1][activeIndex - 1] / DrawPrimitive_Count == layer)
+		{
+			continue;
+		}
+		if (isLayerHidden(m_layerFlags[layer]))
+		{
+			continue; // see endFrame()
+		}
+		Vec3 viewOrigin = m_appData.m_viewOrigin;
+
+	 // sort each primitive list internally
+		for (int i = 0 ; i < DrawPrimitive_Count; ++i)
+		{
+			Vector<VertexData>& vertexData = *(m_vertexData[1][layer * DrawPrimitive_Count + i]);
+			#if IM3D_INDEXED_DRAW_LISTS
+			 // only the indices are reordered, vertex data stays in submission order
+				Vector<U32>& indexData = *(m_indexData[1][layer * DrawPrimitive_Count + i]);
+				const U32 elementCount = indexData.size();
+			#else
+				const U32 elementCount = vertexData.size();
+			#endif
+			sortData[i].clear();
+			if (elementCount > 0)
+			{
+				const ListState* listState = findListState(layer * DrawPrimitive_Count + i);
+				const bool presorted = listState && !listState->m_sortRuns.empty() && listState->m_sortKeys.size() * VertsPerDrawPrimitive[i] == elementCount && SameOrigin(m_presortOrigin, viewOrigin);
+				if (presorted)
+				{
+				 // merged from presorted lists (see presortForMerge()), the keys are known
+					const Vector<float>& sortKeys = listState->m_sortKeys;
+					sortData[i].resize(sortKeys.size());
+					for (U32 e = 0; e < sortKeys.size(); ++e)
+					{
+						sortData[i][e] = SortData(sortKeys[e], e * VertsPerDrawPrimitive[i]);
+					}
+				}
+				else
+				{
+					#if IM3D_INDEXED_DRAW_LISTS
+						GetSortKeys(vertexData.data(), indexData.data(), elementCount, VertsPerDrawPrimitive[i], viewOrigin, sortData[i]);
+					#else
+						GetSortKeys(vertexData.data(), nullptr, elementCount, VertsPerDrawPrimitive[i], viewOrigin, sortData[i]);
+					#endif
+				}
+				Vector<U32>& sortOrder = *m_sortOrder[layer * DrawPrimitive_Count + i];
+				const U32 primCount = sortData[i].size();
+				bool sorted = false;
+				bool seedNextFrame = m_appData.m_sortIncremental && !presorted; // presorted lists aren't in submission order
+				if (presorted && listState->m_sortRuns.size() <= 4)
+				{
+				 // a merge pass costs about 2 radix sort passes, with more runs only the keys are reused
+					Vector<U32>& runEnds = m_sortScratch->m_runEnds;
+					runEnds.clear();
+					runEnds.append(listState->m_sortRuns);
+					MergeRuns(sortData[i], sortScratch, runEnds);
+					sorted = true;
+				}
+				else if (!presorted && m_appData.m_sortIncremental && sortOrder.size() == primCount)
+				{
+				 // seed with the previous frame's order, assume the same primitives were submitted in the same order
+					sortScratch.clear();
+					sortScratch.resize(primCount);
+					for (U32 e = 0; e < primCount; ++e)
+					{
+						sortScratch[e] = sortData[i][sortOrder[e]];
+					}
+					Vector<SortData>::swap(sortData[i], sortScratch);
+					sorted = InsertionSort(sortData[i], primCount);
+				 // if too many primitives moved, skip seeding the next frame (avoid paying for a failed attempt every frame when the view changes quickly)
+					seedNextFrame = sorted;
+				}
+				if (!sorted)
+				{
+					RadixSort(sortData[i], sortScratch);
+				}
+				sortOrder.clear();
+				if (seedNextFrame)
+				{
+					sortOrder.resize(primCount);
+					for (U32 e = 0; e < primCount; ++e)
+					{
+						sortOrder[e] = sortData[i][e].m_start / VertsPerDrawPrimitive[i];
+					}
+				}
+				#if IM3D_INDEXED_DRAW_LISTS
+					Reorder(indexData, m_sortScratch->m_reorder, sortData[i].data(), sortData[i].size(), VertsPerDrawPrimitive[i]);
+				#else
+					if (sortIndexed)
+					{
+						while (m_sortedIndexData.size() % indexAlignment != 0)
+						{
+							m_sortedIndexData.push_back(0); // see AppData::m_drawDataAlignment
+						}
+						sortedIndexStart[i] = m_sortedIndexData.size();
+						for (U32 e = 0; e < sortData[i].size(); ++e)
+						{
+							for (int j = 0; j < VertsPerDrawPrimitive[i]; ++j)
+							{
+								m_sortedIndexData.push_back(sortData[i][e].m_start + j);
+							}
+						}
+					}
+					else
+					{
+						Reorder(vertexData, m_sortScratch->m_reorder, sortData[i].data(), sortData[i].size(), VertsPerDrawPrimitive[i]);
+					}
+				#endif
+			}
+		}
+
+	 // construct draw lists - partition sort data into non-overlapping lists
+		int cprim = 0;
+		SortData* search[DrawPrimitive_Count];
+		int emptyCount = 0;
+		for (int i = 0; i < DrawPrimitive_Count; ++i)
+		{
+			if (sortData[i].empty())
+			{
+				search[i] = 0;
+				++emptyCount;
+			}
+			else
+			{
+				search[i] = sortData[i].begin();
+			}
+		}
+		bool first = true;
+		#define modinc(v) ((v + 1) % DrawPrimitive_Count)
+		while (emptyCount != DrawPrimitive_Count)
+		{
+			while (search[cprim] == 0)
+			{
+				cprim = modinc(cprim);
+			}
+
+		 // find the max key at the current position across all sort data
+			float mxkey = search[cprim]->m_key;
+			int mxprim = cprim;
+			for (int p = modinc(cprim); p != cprim; p = modinc(p))
+			{
+				if (search[p] != 0 && search[p]->m_key > mxkey)
+				{
+					mxkey = search[p]->m_key;
+					mxprim = p;
+				}
+			}
+
+		 // if draw list is empty or the layer or primitive changed, start a new draw list
+			if (false
+				|| first
+				|| (m_drawLists.back().m_layerId  != m_layerIdMap[layer])
+				|| (m_drawLists.back().m_primType != mxprim)
+				)
+			{
+				cprim = mxprim;
+				const U32 listIndex = layer * DrawPrimitive_Count + cprim;
+				const U32 start = (U32)(search[cprim] - sortData[cprim].data()) * VertsPerDrawPrimitive[cprim];
+				DrawList dl;
+				dl.m_layerId     = m_layerIdMap[layer];
+				dl.m_primType    = (DrawPrimitiveType)cprim;
+				#if IM3D_INDEXED_DRAW_LISTS
+					dl.m_vertexData   = getDrawVertexData(1, listIndex);
+					dl.m_vertexCount  = m_vertexData[1][listIndex]->size();
+					dl.m_vertexOffset = getFrameVertexOffset(1, listIndex);
+					dl.m_indexData    = getDrawIndexData(1, listIndex) + start;
+					dl.m_indexOffset  = getFrameIndexOffset(1, listIndex) + start;
+				#else
+					if (sortIndexed)
+					{
+						dl.m_vertexData   = getDrawVertexData(1, listIndex);
+						dl.m_vertexCount  = m_vertexData[1][listIndex]->size();
+						dl.m_vertexOffset = getFrameVertexOffset(1, listIndex);
+						dl.m_indexData    = m_sortedIndexData.data() + sortedIndexStart[cprim] + start;
+						dl.m_indexOffset  = sortedIndexStart[cprim] + start;
+					}
+					else
+					{
+						dl.m_vertexData   = getDrawVertexData(1, listIndex) + start;
+						dl.m_vertexCount  = 0;
+						dl.m_vertexOffset = getFrameVertexOffset(1, listIndex) + start;
+						dl.m_indexData    = nullptr;
+						dl.m_indexOffset  = 0;
+					}
+				#endif
+				dl.m_indexCount   = 0;
+				m_drawLists.push_back(dl);
+				first = false;
+			}
+
+		 // increment the vertex (or index) count for the current draw list
+			#if IM3D_INDEXED_DRAW_LISTS
+				m_drawLists.back().m_indexCount += VertsPerDrawPrimitive[cprim];
+			#else
+				if (sortIndexed)
+				{
+					m_drawLists.back().m_indexCount += VertsPerDrawPrimitive[cprim];
+				}
+				else
+				{
+					m_drawLists.back().m_vertexCount += VertsPerDrawPrimitive[cprim];
+				}
+			#endif
+			++search[cprim];
+			if (search[cprim] == sortData[cprim].end())
+			{
+				search[cprim] = 0;
+				++emptyCount;
+			}
+
+		}
+		#undef modinc
+	}
+
+	m_sortCalled = true;
+}
+
+const DrawVertexData* Context::getDrawVertexData(int _sorted, U32 _list) const
+{
+	#if IM3D_VERTEX_COMPACT
+		return m_frameVertexData.data() + getFrameVertexOffset(_sorted, _list);
+	#else
+		return m_frameDataPacked ? m_frameVertexData.data() + getFrameVertexOffset(_sorted, _list) : m_vertexData[_sorted][_list]->data();
+	#endif
+}
+
+U32 Context::getFrameVertexOffset(int _sorted, U32 _list) const
+{
+	return m_frameDataPacked ? m_frameVertexOffsets[_sorted * m_vertexData[0].size() + _list] : 0;
+}
+
+#if IM3D_INDEXED_DRAW_LISTS
+const U32* Context::getDrawIndexData(int _sorted, U32 _list) const
+{
+	return m_frameDataPacked ? m_frameIndexData.data() + getFrameIndexOffset(_sorted, _list) : m_indexData[_sorted][_list]->data();
+}
+
+U32 Context::getFrameIndexOffset(int _sorted, U32 _list) const
+{
+	return m_frameDataPacked ? m_frameIndexOffsets[_sorted * m_vertexData[0].size() + _list] : 0;
+}
+#endif
+
+void Context::packFrameData()
+{
+	for (U32 i = 0; i < 2; ++i)
+	{
+		for (U32 j : m_activeLists[i])
+		{
+			DrawVertexData* dst = m_frameVertexData.data() + getFrameVertexOffset(i, j);
+			#if IM3D_INDEXED_DRAW_LISTS
+				U32* dstIndex = m_frameIndexData.data() + getFrameIndexOffset(i, j);
+			#endif
+			U32 vertexCount = 0;
+			for (U32 page = 0; page < getPageCount(i, j); ++page)
+			{
+				const VertexList& vertexList = getPageVertexList(i, j, page);
+				#if IM3D_VERTEX_COMPACT
+					ConvertVertexData(vertexList.data(), vertexList.size(), dst + vertexCount);
+				#else
+					if (!vertexList.empty())
+					{
+						memcpy(dst + vertexCount, vertexList.data(), sizeof(VertexData) * vertexList.size());
+					}
+				#endif
+				#if IM3D_INDEXED_DRAW_LISTS
+				 // page indices are relative to the page, rebase to the start of the list
+					const IndexList& indexList = getPageIndexList(i, j, page);
+					if (vertexCount == 0)
+					{
+						if (!indexList.empty())
+						{
+							memcpy(dstIndex, indexList.data(), sizeof(U32) * indexList.size());
+						}
+					}
+					else
+					{
+						for (U32 k = 0; k < indexList.size(); ++k)
+						{
+							dstIndex[k] = indexList[k] + vertexCount;
+						}
+					}
+					dstIndex += indexList.size();
+				#endif
+				vertexCount += vertexList.size();
+			}
+		}
+	}
+}
+
+U32 Context::getPageCount(int _sorted, U32 _list) const
+{
+	const ListState* listState = findListState(_list);
+	return _sorted || !listState ? 1 : listState->m_vertexPages.size() + 1;
+}
+
+Context::VertexList& Context::getPageVertexList(int _sorted, U32 _list, U32 _page) const
+{
+	const ListState* listState = findListState(_list);
+	if (_sorted == 0 && listState && _page < listState->m_vertexPages.size())
+	{
+		return listState->m_vertexPages[_page]->m_vertexData;
+	}
+	return *m_vertexData[_sorted][_list];
+}
+
+#if IM3D_INDEXED_DRAW_LISTS
+Context::IndexList& Context::getPageIndexList(int _sorted, U32 _list, U32 _page) const
+{
+	const ListState* listState = findListState(_list);
+	if (_sorted == 0 && listState && _page < listState->m_vertexPages.size())
+	{
+		return listState->m_vertexPages[_page]->m_indexData;
+	}
+	return *m_indexData[_sorted][_list];
+}
+#endif
+
+void Context::sealPage(U32 _list, U32 _count)
+{
+	const U32 pageSize = m_appData.m_vertexPageSize;
+	VertexList& vertexList = *m_vertexData[0][_list];
+	#if IM3D_INDEXED_DRAW_LISTS
+		IndexList& indexList = *m_indexData[0][_list];
+		const U32 size = vertexList.size() > indexList.size() ? vertexList.size() : indexList.size();
+	#else
+		const U32 size = vertexList.size();
+	#endif
+	if (size == 0 || (size < pageSize && _count <= pageSize - size))
+	{
+		return;
+	}
+	VertexPage* page = allocPage(m_vertexPagesFree);
+
+ // the page takes the data, the list takes the page's (empty) buffer, + headroom for the primitive which crosses the page size
+	VertexList::swap(page->m_vertexData, vertexList);
+	vertexList.clear();
+	vertexList.reserve(pageSize + pageSize / 4);
+	#if IM3D_INDEXED_DRAW_LISTS
+		IndexList::swap(page->m_indexData, indexList);
+		indexList.clear();
+		indexList.reserve(pageSize + pageSize / 4);
+	#endif
+	getListState(_list).m_vertexPages.push_back(page);
+}
+
+void Context::splitPrimitive()
+{
+	IM3D_ASSERT(m_primPageSize != ~0u && m_vertCountThisPrim % VertsPerDrawPrimitive[m_primType] == 0);
+	VertexList* vertexList = getCurrentVertexList();
+	#if IM3D_INDEXED_DRAW_LISTS
+		IndexList* indexList = getCurrentIndexList();
+	#endif
+	#if IM3D_CULL_PRIMITIVES
+	 // the part in the page is culled on its own, the bounds keep growing for the rest of the primitive (see end())
+		if (!isVisible(m_minVertThisPrim - Vec3(1.0f), m_maxVertThisPrim + Vec3(1.0f)))
+		{
+			vertexList->resize(m_firstVertThisPrim);
+			#if IM3D_INDEXED_DRAW_LISTS
+				indexList->resize(m_firstIndexThisPrim, 0);
+			#endif
+		}
+	#endif
+	#if IM3D_INDEXED_DRAW_LISTS
+		m_budgetStats.m_vertexCount += indexList->size() - m_firstIndexThisPrim;
+	#else
+		m_budgetStats.m_vertexCount += vertexList->size() - m_firstVertThisPrim;
+	#endif
+	sealPage(m_layerIndex * DrawPrimitive_Count + m_primType, ~0u);
+	m_firstVertThisPrim = vertexList->size();
+	#if IM3D_INDEXED_DRAW_LISTS
+		m_firstIndexThisPrim = indexList->size();
+	#endif
+}
+
+void Context::releasePages(U32 _list)
+{
+	ListState* listState = m_listState[_list];
+	if (!listState)
+	{
+		return;
+	}
+	for (VertexPage* page : listState->m_vertexPages)
+	{
+		if (page->m_linked)
+		{
+			page->m_vertexData.release(); // drop the reference
+			#if IM3D_INDEXED_DRAW_LISTS
+				page->m_indexData.release();
+			#endif
+			page->m_linked = false;
+			m_linkedPagesFree.push_back(page);
+			continue;
+		}
+		if (page->m_vertexData.isExternal())
+		{
+			page->m_vertexData.release(); // app-owned memory (see VertexStorage) is only valid for 1 frame
+		}
+		page->m_vertexData.clear();
+		#if IM3D_INDEXED_DRAW_LISTS
+			page->m_indexData.clear();
+		#endif
+		m_vertexPagesFree.push_back(page);
+	}
+	listState->m_vertexPages.clear();
+}
+
+#if IM3D_INDEXED_DRAW_LISTS
+void Context::linkPage(U32 _list, const VertexList& _vertexData, const IndexList& _indexData)
+#else
+void Context::linkPage(U32 _list, const VertexList& _vertexData)
+#endif
+{
+	sealPage(_list, ~0u); // anything already in the list is drawn first
+	VertexPage* page = allocPage(m_linkedPagesFree);
+	page->m_vertexData.reference(_vertexData.data(), _vertexData.size());
+	#if IM3D_INDEXED_DRAW_LISTS
+		page->m_indexData.reference(_indexData.data(), _indexData.size());
+	#endif
+	page->m_linked = true;
+	getListState(_list).m_vertexPages.push_back(page);
+}
+
+void Context::unlinkPages(U32 _list)
+{
+	const ListState* listState = findListState(_list);
+	if (!listState)
+	{
+		return;
+	}
+	for (VertexPage* page : listState->m_vertexPages)
+	{
+		if (!page->m_linked)
+		{
+			continue;
+		}
+		VertexList vertexData;
+		vertexData.setAllocator(&m_allocator);
+		vertexData.append(page->m_vertexData);
+		VertexList::swap(page->m_vertexData, vertexData);
+		#if IM3D_INDEXED_DRAW_LISTS
+			IndexList indexData;
+			indexData.setAllocator(&m_allocator);
+			indexData.append(page->m_indexData);
+			IndexList::swap(page->m_indexData, indexData);
+		#endif
+		page->m_linked = false; // returned to m_vertexPagesFree by releasePages()
+	}
+}
+
+bool Context::isPageLinked(int _sorted, U32 _list, U32 _page) const
+{
+	const ListState* listState = findListState(_list);
+	if (_sorted || !listState)
+	{
+		return false;
+	}
+	return _page < listState->m_vertexPages.size() && listState->m_vertexPages[_page]->m_linked;
+}
+
+Context::VertexPage* Context::allocPage(Vector<VertexPage*>& _free_)
+{
+	if (!_free_.empty())
+	{
+		VertexPage* page = _free_.back();
+		_free_.pop_back();
+		return page;
+	}
+	VertexPage* page = (VertexPage*)AlignedMalloc(sizeof(VertexPage), alignof(VertexPage), &m_allocator);
+	*page = VertexPage();
+	page->m_vertexData.setAllocator(&m_allocator);
+	#if IM3D_INDEXED_DRAW_LISTS
+		page->m_indexData.setAllocator(&m_allocator);
+	#endif
+	return page;
+}
+
+void Context::presortForMerge()
+{
+	IM3D_ASSERT(!m_endFrameCalled && m_primMode == PrimitiveMode_None);
+	SortScratch& scratch = getSortScratch();
+	Vector<SortData>& sortData = scratch.m_sortData[0];
+	Vector<SortData>& sortScratch = scratch.m_sortData[DrawPrimitive_Count];
+	m_presortOrigin = m_appData.m_viewOrigin;
+	for (U32 list : m_activeLists[1])
+	{
+		if (!isLayerRecording(m_layerFlags[list / DrawPrimitive_Count]) || m_vertexData[1][list]->empty())
+		{
+			continue; // not merged
+		}
+		const U32 prim = list % DrawPrimitive_Count;
+		VertexList& vertexData = *m_vertexData[1][list];
+		#if IM3D_INDEXED_DRAW_LISTS
+			IndexList& indexData = *m_indexData[1][list];
+			GetSortKeys(vertexData.data(), indexData.data(), indexData.size(), VertsPerDrawPrimitive[prim], m_presortOrigin, sortData);
+			RadixSort(sortData, sortScratch);
+			Reorder(indexData, scratch.m_reorder, sortData.data(), sortData.size(), VertsPerDrawPrimitive[prim]);
+		#else
+			GetSortKeys(vertexData.data(), nullptr, vertexData.size(), VertsPerDrawPrimitive[prim], m_presortOrigin, sortData);
+			RadixSort(sortData, sortScratch);
+			Reorder(vertexData, scratch.m_reorder, sortData.data(), sortData.size(), VertsPerDrawPrimitive[prim]);
+		#endif
+		ListState& listState = getListState(list);
+		Vector<float>& sortKeys = listState.m_sortKeys;
+		sortKeys.resize(sortData.size());
+		for (U32 e = 0; e < sortData.size(); ++e)
+		{
+			sortKeys[e] = sortData[e].m_key;
+		}
+		listState.m_sortRuns.clear();
+	}
+}
+
+void Context::mergeSortRun(const Context& _src, U32 _srcList, U32 _dstList, U32 _dstCount)
+{
+	const U32 prim = _dstList % DrawPrimitive_Count;
+	const U32 vertsPerPrim = VertsPerDrawPrimitive[prim];
+	const ListState* srcState = _src.findListState(_srcList);
+	#if IM3D_INDEXED_DRAW_LISTS
+		const U32 srcCount = _src.m_indexData[1][_srcList]->size();
+	#else
+		const U32 srcCount = _src.m_vertexData[1][_srcList]->size();
+	#endif
+	const ListState* dstState = findListState(_dstList);
+	const U32 dstKeyCount = dstState ? dstState->m_sortKeys.size() : 0;
+	const Vec3& viewOrigin = m_appData.m_viewOrigin;
+	if (!srcState || srcState->m_sortKeys.size() * vertsPerPrim != srcCount || !SameOrigin(_src.m_presortOrigin, viewOrigin)
+		|| dstKeyCount * vertsPerPrim != _dstCount || (dstKeyCount != 0 && !SameOrigin(m_presortOrigin, viewOrigin)))
+	{
+		clearSortKeys(_dstList); // _dstList isn't empty after the merge so it stays invalid
+		return;
+	}
+	ListState& listState = getListState(_dstList);
+	Vector<float>& sortKeys = listState.m_sortKeys;
+	Vector<U32>& sortRuns = listState.m_sortRuns;
+	if (sortRuns.empty() && !sortKeys.empty())
+	{
+		sortRuns.push_back(sortKeys.size()); // presorted by this context
+	}
+	sortKeys.append(srcState->m_sortKeys);
+	sortRuns.push_back(sortKeys.size());
+	m_presortOrigin = viewOrigin;
+}
+
+void Context::clearSortKeys(U32 _list)
+{
+	ListState* listState = m_listState[_list];
+	if (listState)
+	{
+		listState->m_sortKeys.clear();
+		listState->m_sortRuns.clear();
+	}
+}
+
+Context::ListState& Context::getListState(U32 _list)
+{
+	ListState*& listState = m_listState[_list];
+	if (listState)
+	{
+		return *listState;
+	}
+	if (!m_listStateFree.empty())
+	{
+		listState = m_listStateFree.back();
+		m_listStateFree.pop_back();
+		return *listState;
+	}
+	listState = (ListState*)AlignedMalloc(sizeof(ListState), alignof(ListState), &m_allocator);
+	*listState = ListState();
+	listState->m_sortKeys.setAllocator(&m_allocator);
+	listState->m_sortRuns.setAllocator(&m_allocator);
+	listState->m_vertexPages.setAllocator(&m_allocator);
+	return *listState;
+}
+
+int Context::findMergeLayer(const Context& _src, U32 _layer) const
+{
+	const int layerIndex = findLayerIndex(_src.m_layerIdMap[_layer]);
+	IM3D_ASSERT(layerIndex >= 0);
+	if (!isLayerRecording(_src.m_layerFlags[_layer]) || !isLayerRecording(m_layerFlags[layerIndex]))
+	{
+		return -1; // as for draw calls, skip disabled or already recorded retained layers
+	}
+	return layerIndex;
+}
+
+int Context::findMergeList(const Context& _src, U32 _list) const
+{
+	const int layerIndex = findMergeLayer(_src, _list / DrawPrimitive_Count);
+	return layerIndex < 0 ? -1 : layerIndex * DrawPrimitive_Count + _list % DrawPrimitive_Count;
+}
+
+bool Context::isMergeLinked(int _sorted, U32 _list, const VertexList& _vertexData) const
+{
+ // retained layers must own their data, sorted lists are rewritten by sort(), app-owned memory (see VertexStorage) is never committed by the source
+	return _sorted == 0 && m_appData.m_mergeLinked && (m_layerFlags[_list / DrawPrimitive_Count] & LayerFlags_Retained) == 0 && !_vertexData.isExternal();
+}
+
+void Context::MergeTask(U32 _index, void* _taskData)
+{
+	const Context& ctx = *(const Context*)_taskData;
+	for (U32 n = ctx.m_mergeTasks[_index]; n < ctx.m_mergeTasks[_index + 1]; ++n)
+	{
+		const MergeCopy& copy = ctx.m_mergeCopies[n];
+		memcpy(copy.m_dst, copy.m_src, sizeof(VertexData) * copy.m_count);
+		#if IM3D_INDEXED_DRAW_LISTS
+			for (U32 i = 0; i < copy.m_indexCount; ++i)
+			{
+				copy.m_dstIndices[i] = copy.m_srcIndices[i] + copy.m_indexOffset;
+			}
+		#endif
+	}
+}
+
+namespace {
+	// Hash for m_layerIdHash, _id may be a small integer so mix the bits.
+	inline U32 HashLayerId(Id _id)
+	{
+		U32 h = _id * 0x9e3779b1u;
+		return h ^ (h >> 16);
+	}
+}
+
+int Context::findLayerIndex(Id _id) const
+{
+	if (m_layerIdHash.empty())
+	{
+		return -1;
+	}
+	const U32 mask = m_layerIdHash.size() - 1;
+	for (U32 i = HashLayerId(_id) & mask; ; i = (i + 1) & mask)
+	{
+		const U32 entry = m_layerIdHash[i];
+		if (entry == 0)
+		{
+			return -1;
+		}
+		if (m_layerIdMap[entry - 1] == _id)
+		{
+			return (int)entry - 1;
+		}
+	}
+}
+
+void Context::collectLayers()
+{
+	U32 count = 0;
+	for (U32 i = 0; i < m_layerIdMap.size(); ++i)
+	{
+		const bool keep = false
+			|| (int)i == m_layerIndex // default layer
+			|| m_layerFlags[i] != 0 // disabled/retained/budget
+			|| (m_frameIndex - m_layerLastUsed[i]) <= m_appData.m_layerMaxUnusedFrames
+			;
+		if (!keep)
+		{
+		 // release the memory, return the lists to the pool
+			LayerLists& layerLists = *m_layerLists[i];
+			for (int j = 0; j < DrawPrimitive_Count; ++j)
+			{
+				const U32 list = i * DrawPrimitive_Count + j;
+				releasePages(list);
+				if (ListState* listState = m_listState[list])
+				{
+					listState->m_sortKeys.release();
+					listState->m_sortRuns.release();
+					listState->m_vertexPages.release();
+					m_listStateFree.push_back(listState);
+				}
+				for (int k = 0; k < 2; ++k)
+				{
+					layerLists.m_vertexData[k][j].release();
+					#if IM3D_INDEXED_DRAW_LISTS
+						layerLists.m_indexData[k][j].release();
+					#endif
+				}
+				layerLists.m_sortOrder[j].release();
+			}
+			layerLists.m_textData.release();
+			m_layerListsFree.push_back(&layerLists);
+			continue;
+		}
+
+	 // compact the remaining layers, preserving the order
+		if (count != i)
+		{
+			m_layerIdMap[count]    = m_layerIdMap[i];
+			m_layerFlags[count]    = m_layerFlags[i];
+			m_layerLastUsed[count] = m_layerLastUsed[i];
+			m_layerLists[count]    = m_layerLists[i];
+			m_textData[count]      = m_textData[i];
+			for (int j = 0; j < DrawPrimitive_Count; ++j)
+			{
+				const U32 dst = count * DrawPrimitive_Count + j;
+				const U32 src = i * DrawPrimitive_Count + j;
+				for (int k = 0; k < 2; ++k)
+				{
+					m_vertexData[k][dst] = m_vertexData[k][src];
+					m_listActive[k][dst] = m_listActive[k][src];
+					#if IM3D_INDEXED_DRAW_LISTS
+						m_indexData[k][dst] = m_indexData[k][src];
+					#endif
+				}
+				m_sortOrder[dst] = m_sortOrder[src];
+				m_listState[dst] = m_listState[src];
+			}
+		}
+		++count;
+	}
+	if (count == m_layerIdMap.size())
+	{
+		return;
+	}
+
+	m_layerIdMap.resize(count);
+	m_layerFlags.resize(count);
+	m_layerLastUsed.resize(count);
+	m_layerLists.resize(count);
+	m_textData.resize(count);
+	for (int k = 0; k < 2; ++k)
+	{
+		m_vertexData[k].resize(count * DrawPrimitive_Count);
+		m_listActive[k].resize(count * DrawPrimitive_Count);
+		#if IM3D_INDEXED_DRAW_LISTS
+			m_indexData[k].resize(count * DrawPrimitive_Count);
+		#endif
+	}
+	m_sortOrder.resize(count * DrawPrimitive_Count);
+	m_listState.resize(count * DrawPrimitive_Count);
+
+ // rebuild the active sets (only retained layers are active here, see reset())
+	for (int k = 0; k < 2; ++k)
+	{
+		m_activeLists[k].clear();
+		for (U32 i = 0; i < m_listActive[k].size(); ++i)
+		{
+			if (m_listActive[k][i])
+			{
+				m_activeLists[k].push_back(i);
+			}
+		}
+	}
+	m_activeTextLayers.clear();
+	for (U32 i = 0; i < count; ++i)
+	{
+		if (m_layerFlags[i] & LayerFlags_TextActive)
+		{
+			m_activeTextLayers.push_back(i);
+		}
+	}
+
+ // rebuild the hash table
+	for (U32& entry : m_layerIdHash)
+	{
+		entry = 0;
+	}
+	for (U32 i = 0; i < count; ++i)
+	{
+		insertLayerIndex(m_layerIdMap[i], i);
+	}
+	m_layerIndex = findLayerIndex(m_layerIdStack.back());
+}
+
+U32 Context::findOrAddLayerIndex(Id _id)
+{
+	int idx = findLayerIndex(_id);
+	if (idx == -1)
+	{
+		pushLayerId(_id);
+		popLayerId();
+		idx = m_layerIdMap.size() - 1;
+		m_layerFlags[idx] &= ~LayerFlags_Used; // not pushed by the app
+		m_usedLayers.pop_back();
+	}
+	return (U32)idx;
+}
+
+void Context::updateLayerState()
+{
+	const U32 flags = m_layerFlags[m_layerIndex];
+	m_layerRecording = isLayerRecording(flags);
+	m_layerRetained  = (flags & LayerFlags_Retained) != 0;
+}
+
+static const U32 kFrameArenaAlignment = 16;
+
+void Context::resetFrameArena()
+{
+ // drop all references to the arena, internal memory (e.g. if the arena overflowed last frame) is kept
+	Vector<U32>* indexVectors[] =
+	{
+		&m_frameVertexOffsets,
+		#if IM3D_INDEXED_DRAW_LISTS
+			&m_frameIndexOffsets,
+		#else
+			&m_sortedIndexData,
+		#endif
+	};
+	for (Vector<U32>* v : indexVectors)
+	{
+		if (v->isExternal())
+		{
+			v->release();
+		}
+	}
+	if (m_drawLists.isExternal())
+	{
+		m_drawLists.release();
+	}
+	if (m_textDrawLists.isExternal())
+	{
+		m_textDrawLists.release();
+	}
+	if (m_textBuffer.isExternal())
+	{
+		m_textBuffer.release();
+	}
+
+	if (isFrameArenaEnabled())
+	{
+		if (m_frameArenaRequired > m_frameArenaSize)
+		{
+		 // grow to fit the previous frame (+25%)
+			if (m_frameArena)
+			{
+				AlignedFree(m_frameArena, &m_allocator);
+			}
+			m_frameArenaSize = m_frameArenaRequired + m_frameArenaRequired / 4;
+			m_frameArena = (char*)AlignedMalloc(m_frameArenaSize, kFrameArenaAlignment, &m_allocator);
 		}
-		m_textData.push_back((TextList*)IM3D_MALLOC(sizeof(TextList)));
-		*m_textData.back() = TextList();
 	}
-	m_layerIdStack.push_back(_layer);
-	m_layerIndex = idx;
+	else if (m_frameArena)
+	{
+		AlignedFree(m_frameArena, &m_allocator);
+		m_frameArena = nullptr;
+		m_frameArenaSize = 0;
+	}
+	m_frameArenaUsed = 0;
+	m_frameArenaLast = 0;
+	m_frameArenaRequired = 0;
+
+	const VertexStorage* storage = isFrameArenaEnabled() ? &m_frameArenaStorage : nullptr;
+	for (Vector<U32>* v : indexVectors)
+	{
+		v->setStorage(storage);
+	}
+	m_drawLists.setStorage(storage);
+	m_textDrawLists.setStorage(storage);
+	m_textBuffer.setStorage(storage);
 }
-void Context::popLayerId()
+
+void* Context::FrameArenaAllocate(U32 _size, void* _userData)
 {
-	IM3D_ASSERT(m_layerIdStack.size() > 1);
-	m_layerIdStack.pop_back();
-	m_layerIndex = findLayerIndex(m_layerIdStack.back());
+	Context& ctx = *(Context*)_userData;
+	const U32 offset = (ctx.m_frameArenaUsed + kFrameArenaAlignment - 1) & ~(kFrameArenaAlignment - 1);
+	ctx.m_frameArenaRequired = ((ctx.m_frameArenaRequired + kFrameArenaAlignment - 1) & ~(kFrameArenaAlignment - 1)) + _size;
+	if (offset + _size > ctx.m_frameArenaSize)
+	{
+		return nullptr; // fall back to m_allocator, the arena grows during the next reset()
+	}
+	ctx.m_frameArenaUsed = offset + _size;
+	ctx.m_frameArenaLast = offset;
+	return ctx.m_frameArena + offset;
 }
 
-Context::Context()
+void* Context::FrameArenaGrow(void* _data, U32 /*_usedSize*/, U32 _size, void* _userData)
 {
-	m_sortCalled = false;
-	m_endFrameCalled = false;
-	m_primMode = PrimitiveMode_None;
-	m_vertexDataIndex = 0; // = sorting disabled
-	m_layerIndex = 0;
-	m_firstVertThisPrim = 0;
-	m_vertCountThisPrim = 0;
-
-	m_gizmoLocal = false;
-	m_gizmoMode = GizmoMode_Translation;
-	m_hotId = Id_Invalid;
-	m_activeId = Id_Invalid;
-	m_appId = Id_Invalid;
-	m_appActiveId = Id_Invalid;
-	m_appHotId = Id_Invalid;
-	m_hotDepth = FLT_MAX;
-	m_gizmoHeightPixels = 64.0f;
-	m_gizmoSizePixels = 5.0f;
+	Context& ctx = *(Context*)_userData;
+	if (_data != ctx.m_frameArena + ctx.m_frameArenaLast || ctx.m_frameArenaLast + _size > ctx.m_frameArenaSize)
+	{
+		return nullptr; // not the last allocation or doesn't fit, Vector::reserve() allocates + copies the used size
+	}
+	ctx.m_frameArenaRequired += ctx.m_frameArenaLast + _size - ctx.m_frameArenaUsed;
+	ctx.m_frameArenaUsed = ctx.m_frameArenaLast + _size;
+	return _data;
+}
 
-	memset(&m_keyDownCurr, 0, sizeof(m_keyDownCurr));
-	memset(&m_keyDownPrev, 0, sizeof(m_keyDownPrev));
+#if IM3D_ALLOC_TRACKING
+static const size_t kAllocHeaderSize = 16; // stores the size, preserves the alignment of the app allocator
 
- // init cull frustum to INF effectively disables culling
-	for (int i = 0; i < FrustumPlane_Count; ++i)
+void* Context::TrackedAllocate(size_t _size, void* _userData)
+{
+	Context& ctx = *(Context*)_userData;
+	IM3D_ASSERT(ctx.m_appData.m_allocWarmupFrames == 0 || ctx.m_frameIndex <= ctx.m_appData.m_allocWarmupFrames); // allocation after the warm-up, see AppData::m_allocWarmupFrames
+	const Allocator& app = ctx.m_appAllocator;
+	char* mem = app.m_allocate
+		? (char*)app.m_allocate(_size + kAllocHeaderSize, app.m_userData)
+		: (char*)IM3D_MALLOC(_size + kAllocHeaderSize)
+		;
+	if (!mem)
 	{
-		m_appData.m_cullFrustum[i] = Vec4(INFINITY);
+		return nullptr;
+	}
+	*((size_t*)mem) = _size;
+	AllocStats& stats = ctx.m_allocStats;
+	++stats.m_allocCount;
+	++stats.m_frameAllocCount;
+	stats.m_allocBytes += _size;
+	stats.m_frameAllocBytes += _size;
+	stats.m_liveBytes += _size;
+	stats.m_peakBytes = stats.m_liveBytes > stats.m_peakBytes ? stats.m_liveBytes : stats.m_peakBytes;
+	return mem + kAllocHeaderSize;
+}
+
+void Context::TrackedFree(void* _ptr, void* _userData)
+{
+	Context& ctx = *(Context*)_userData;
+	char* mem = (char*)_ptr - kAllocHeaderSize;
+	AllocStats& stats = ctx.m_allocStats;
+	++stats.m_freeCount;
+	stats.m_liveBytes -= *((size_t*)mem);
+	const Allocator& app = ctx.m_appAllocator;
+	if (app.m_free)
+	{
+		app.m_free(mem, app.m_userData);
+	}
+	else
+	{
+		IM3D_FREE(mem);
 	}
-
-	pushMatrix(Mat4(1.0f));
-	pushColor(Color_White);
-	pushAlpha(1.0f);
-	pushSize(1.0f);
-	pushEnableSorting(false);
-	pushLayerId(0);
-	pushId(0x811C9DC5u); // fnv1 hash base
 }
+#endif
 
-Context::~Context()
+void Context::markListActive(int _sorted, U32 _list)
 {
-	for (int i = 0; i < 2; ++i)
+	if (!m_listActive[_sorted][_list])
 	{
-		while (!m_vertexData[i].empty())
-		{
-			m_vertexData[i].back()->~Vector(); // manually call dtor (vector is allocated via IM3D_MALLOC during pushLayerId)
-			IM3D_FREE(m_vertexData[i].back());
-			m_vertexData[i].pop_back();
-		}
+		m_listActive[_sorted][_list] = true;
+		m_activeLists[_sorted].push_back(_list);
+		#if IM3D_VIRTUAL_MEMORY
+			m_vertexData[_sorted][_list]->setVirtual(m_appData.m_vertexListReserve, m_appData.m_vertexListHugePages);
+			#if IM3D_INDEXED_DRAW_LISTS
+				m_indexData[_sorted][_list]->setVirtual(m_appData.m_vertexListReserve, m_appData.m_vertexListHugePages);
+			#endif
+		#endif
 	}
+}
 
-	while (!m_textData.empty())
+void Context::markTextActive(U32 _layer)
+{
+	if ((m_layerFlags[_layer] & LayerFlags_TextActive) == 0)
 	{
-		m_textData.back()->~Vector(); // see above
-		IM3D_FREE(m_textData.back());
-		m_textData.pop_back();
+		m_layerFlags[_layer] |= LayerFlags_TextActive;
+		m_activeTextLayers.push_back(_layer);
 	}
 }
 
 namespace {
-	struct SortData
+	int CompareU32(const void* _a, const void* _b)
 	{
-		float       m_key;
-		VertexData* m_start;
-		SortData() {}
-		SortData(float _key, VertexData* _start): m_key(_key), m_start(_start) {}
-	};
+		const U32 a = *(const U32*)_a;
+		const U32 b = *(const U32*)_b;
+		return a < b ? -1 : (a > b ? 1 : 0);
+	}
+}
+
+void Context::sortActiveLists()
+{
+	qsort(m_activeLists[0].data(), m_activeLists[0].size(), sizeof(U32), CompareU32);
+	qsort(m_activeLists[1].data(), m_activeLists[1].size(), sizeof(U32), CompareU32);
+	qsort(m_activeTextLayers.data(), m_activeTextLayers.size(), sizeof(U32), CompareU32);
+}
+
+void Context::updatePrimBudget()
+{
+	const U32 flags = m_layerFlags[m_layerIndex];
+	m_primBudgetLayer = true;
+	if (flags & LayerFlags_Dropped)
+	{
+		m_primVertexBudget = 0;
+		return;
+	}
 
-	int SortCmp(const void* _a, const void* _b)
+ // keep-nearest budgets record up to 2x the limit, trim back to the limit when 1.5x is exceeded so that the trim cost is amortized
+	U32 remaining = ~0u;
+	const Budget& contextBudget = m_appData.m_budget;
+	if (contextBudget.m_maxVertices)
 	{
-		float ka = ((SortData*)_a)->m_key;
-		float kb = ((SortData*)_b)->m_key;
-		if (ka < kb)
+		U32 capacity = contextBudget.m_maxVertices;
+		if (contextBudget.m_policy == BudgetPolicy_KeepNearest)
 		{
-			return 1;
+			if (m_budgetStats.m_vertexCount > capacity + capacity / 2)
+			{
+				keepNearest(-1, capacity);
+			}
+			capacity *= 2;
 		}
-		else if (ka > kb)
+		remaining = capacity > m_budgetStats.m_vertexCount ? capacity - m_budgetStats.m_vertexCount : 0;
+	}
+	m_primBudgetLayer = false;
+	const Budget& layerBudget = m_layerLists[m_layerIndex]->m_budget;
+	if ((flags & LayerFlags_Budget) && layerBudget.m_maxVertices)
+	{
+		U32 capacity = layerBudget.m_maxVertices;
+		U32 count = getLayerVertexCount(m_layerIndex);
+		if (layerBudget.m_policy == BudgetPolicy_KeepNearest)
 		{
-			return -1;
+			if (count > capacity + capacity / 2)
+			{
+				keepNearest(m_layerIndex, capacity);
+				count = getLayerVertexCount(m_layerIndex);
+			}
+			capacity *= 2;
 		}
-		else
+		const U32 layerRemaining = capacity > count ? capacity - count : 0;
+		if (layerRemaining < remaining)
 		{
-			return 0;
+			remaining = layerRemaining;
+			m_primBudgetLayer = true;
 		}
 	}
 
-	void Reorder(Vector<VertexData>& _data_, const SortData* _sort, U32 _sortCount, U32 _primSize)
+ // vertex() checks the budget before writing, strip modes write up to 2 extra elements per vertex and line loops add 2 during end()
+	U32 slack = 0;
+	switch (m_primMode)
 	{
-		Vector<VertexData> ret;
-		ret.reserve(_data_.size());
-		for (U32 i = 0; i < _sortCount; ++i)
+		case PrimitiveMode_LineStrip:
+			slack = 1;
+			break;
+		case PrimitiveMode_LineLoop:
+			slack = 3;
+			break;
+		case PrimitiveMode_TriangleStrip:
+			slack = 2;
+			break;
+		default:
+			break;
+	};
+	m_primVertexBudget = remaining > slack ? remaining - slack : 0;
+}
+
+void Context::dropPrimitive(U32 _count)
+{
+	m_budgetStats.m_droppedVertices += m_vertCountThisPrim + _count;
+	if (m_vertCountThisPrim > 0)
+	{
+		getCurrentVertexList()->resize(m_firstVertThisPrim);
+		#if IM3D_INDEXED_DRAW_LISTS
+			getCurrentIndexList()->resize(m_firstIndexThisPrim, 0);
+		#endif
+		m_vertCountThisPrim = 0;
+	}
+	m_primVertexBudget = 0; // drop the rest of the primitive
+
+	const Budget& budget = m_primBudgetLayer ? m_layerLists[m_layerIndex]->m_budget : m_appData.m_budget;
+	if (budget.m_policy == BudgetPolicy_DropLayer && (m_layerFlags[m_layerIndex] & LayerFlags_Dropped) == 0)
+	{
+		dropLayer(m_layerIndex);
+	}
+}
+
+bool Context::checkTextBudget(U32 _bytes)
+{
+	if (m_layerFlags[m_layerIndex] & LayerFlags_Dropped)
+	{
+		++m_budgetStats.m_droppedText;
+		return false;
+	}
+	const LayerLists& layerLists = *m_layerLists[m_layerIndex];
+	const Budget* exceeded = nullptr;
+	if ((m_layerFlags[m_layerIndex] & LayerFlags_Budget) && layerLists.m_budget.m_maxTextBytes && layerLists.m_textBytes + _bytes > layerLists.m_budget.m_maxTextBytes)
+	{
+		exceeded = &layerLists.m_budget;
+	}
+	else if (m_appData.m_budget.m_maxTextBytes && m_budgetStats.m_textBytes + _bytes > m_appData.m_budget.m_maxTextBytes)
+	{
+		exceeded = &m_appData.m_budget;
+	}
+	if (!exceeded)
+	{
+		return true;
+	}
+	++m_budgetStats.m_droppedText;
+	if (exceeded->m_policy == BudgetPolicy_DropLayer)
+	{
+		dropLayer(m_layerIndex);
+	}
+	return false;
+}
+
+void Context::dropLayer(U32 _layer)
+{
+	IM3D_ASSERT((m_layerFlags[_layer] & LayerFlags_Dropped) == 0);
+	U32 recordingCount = 0; // the current primitive isn't counted in m_budgetStats yet
+	if ((int)_layer == m_layerIndex && m_primMode != PrimitiveMode_None)
+	{
+		recordingCount = m_vertCountThisPrim;
+		m_vertCountThisPrim = 0;
+		m_primVertexBudget = 0;
+		m_firstVertThisPrim = 0;
+		#if IM3D_INDEXED_DRAW_LISTS
+			m_firstIndexThisPrim = 0;
+		#endif
+	}
+	const U32 count = getLayerVertexCount(_layer);
+	for (U32 i = 0; i < DrawPrimitive_Count; ++i)
+	{
+		const U32 list = _layer * DrawPrimitive_Count + i;
+		releasePages(list);
+		for (U32 j = 0; j < 2; ++j)
 		{
-			for (U32 j = 0; j < _primSize; ++j)
-			{
-				ret.push_back(*(_sort[i].m_start + j));
-			}
+			#if IM3D_INDEXED_DRAW_LISTS
+				m_indexData[j][list]->clear();
+			#endif
+			m_vertexData[j][list]->clear();
 		}
-		Vector<VertexData>::swap(_data_, ret);
+		clearSortKeys(list);
 	}
+	m_budgetStats.m_vertexCount -= count - recordingCount;
+	m_budgetStats.m_droppedVertices += count;
+
+	LayerLists& layerLists = *m_layerLists[_layer];
+	m_budgetStats.m_textBytes -= layerLists.m_textBytes;
+	m_budgetStats.m_droppedText += m_textData[_layer]->size();
+	m_textData[_layer]->clear();
+	layerLists.m_textBytes = 0;
+
+	m_layerFlags[_layer] |= LayerFlags_Dropped;
+	m_droppedLayers.push_back(_layer);
+	++m_budgetStats.m_droppedLayers;
 }
 
-void Context::sort()
+void Context::keepNearest(int _layer, U32 _maxVertices)
 {
-	static IM3D_THREAD_LOCAL Vector<SortData> sortData[DrawPrimitive_Count]; // reduces # allocs
+	SortScratch& scratch = getSortScratch();
+	Vector<SortData>& sortData = scratch.m_sortData[0];
+	Vector<SortData>& sortScratch = scratch.m_sortData[DrawPrimitive_Count];
+	const Vec3 viewOrigin = m_appData.m_viewOrigin;
 
-	for (U32 layer = 0; layer < m_layerIdMap.size(); ++layer)
+ // key each primitive by its midpoint distance to the view origin (as sort()), m_start is the primitive ordinal << 2 | the primitive type
+	sortData.clear();
+	for (U32 i = 0; i < 2; ++i)
 	{
-		Vec3 viewOrigin = m_appData.m_viewOrigin;
-
-	 // sort each primitive list internally
-		for (int i = 0 ; i < DrawPrimitive_Count; ++i)
+		for (U32 list : m_activeLists[i])
 		{
-			Vector<VertexData>& vertexData = *(m_vertexData[1][layer * DrawPrimitive_Count + i]);
-			sortData[i].clear();
-			if (!vertexData.empty())
+			const U32 layer = list / DrawPrimitive_Count;
+			if ((_layer >= 0 && layer != (U32)_layer) || (m_layerFlags[layer] & LayerFlags_Recorded))
+			{
+				continue; // retained data was already budgeted when it was recorded
+			}
+			const U32 type = list % DrawPrimitive_Count;
+			const U32 vertsPerPrim = VertsPerDrawPrimitive[type];
+			for (U32 page = 0; page < getPageCount(i, list); ++page)
 			{
-				sortData[i].reserve(vertexData.size() / VertsPerDrawPrimitive[i]);
-				for (VertexData* v = vertexData.begin(); v != vertexData.end(); )
+				const VertexList& vertexData = getPageVertexList(i, list, page);
+				#if IM3D_INDEXED_DRAW_LISTS
+					const IndexList& indexData = getPageIndexList(i, list, page);
+					const U32 elementCount = indexData.size();
+				#else
+					const U32 elementCount = vertexData.size();
+				#endif
+				for (U32 e = 0; e < elementCount; e += vertsPerPrim)
 				{
-					sortData[i].push_back(SortData(0.0f, v));
-					IM3D_ASSERT(v < vertexData.end());
-					for (int j = 0; j < VertsPerDrawPrimitive[i]; ++j, ++v)
+					float key = 0.0f;
+					for (U32 j = 0; j < vertsPerPrim; ++j)
 					{
-					 // sort key is the primitive midpoint distance to view origin
-						sortData[i].back().m_key += Length2(Vec3(v->m_positionSize) - viewOrigin);
+						#if IM3D_INDEXED_DRAW_LISTS
+							const VertexData& v = vertexData[indexData[e + j]];
+						#else
+							const VertexData& v = vertexData[e + j];
+						#endif
+						key += Length2(Vec3(v.m_positionSize) - viewOrigin);
 					}
-					sortData[i].back().m_key /= (float)VertsPerDrawPrimitive[i];
+					sortData.push_back(SortData(key / (float)vertsPerPrim, (sortData.size() << 2) | type));
 				}
-			 // qsort is not necessarily stable but it doesn't matter assuming the prims are pushed in roughly the same order each frame
-				qsort(sortData[i].data(), sortData[i].size(), sizeof(SortData), SortCmp);
-				Reorder(vertexData, sortData[i].data(), sortData[i].size(), VertsPerDrawPrimitive[i]);
 			}
 		}
+	}
+	RadixSort(sortData, sortScratch);
+
+ // sortData is back to front, keep the nearest primitives which fit
+	Vector<bool>& keep = scratch.m_keep;
+	keep.clear();
+	keep.resize(sortData.size(), false);
+	U32 keepCount = 0;
+	for (U32 i = sortData.size(); i > 0; --i)
+	{
+		const U32 vertsPerPrim = VertsPerDrawPrimitive[sortData[i - 1].m_start & 3];
+		if (keepCount + vertsPerPrim > _maxVertices)
+		{
+			break;
+		}
+		keepCount += vertsPerPrim;
+		keep[sortData[i - 1].m_start >> 2] = true;
+	}
 
-	 // construct draw lists - partition sort data into non-overlapping lists
-		int cprim = 0;
-		SortData* search[DrawPrimitive_Count];
-		int emptyCount = 0;
-		for (int i = 0; i < DrawPrimitive_Count; ++i)
+ // compact the lists in place, visiting the primitives in the same order as above so that primitive ordinals match
+	U32 primIndex = 0;
+	U32 removeCount = 0;
+	for (U32 i = 0; i < 2; ++i)
+	{
+		for (U32 list : m_activeLists[i])
 		{
-			if (sortData[i].empty())
-			{
-				search[i] = 0;
-				++emptyCount;
-			}
-			else
+			const U32 layer = list / DrawPrimitive_Count;
+			if ((_layer >= 0 && layer != (U32)_layer) || (m_layerFlags[layer] & LayerFlags_Recorded))
 			{
-				search[i] = sortData[i].begin();
+				continue;
 			}
-		}
-		bool first = true;
-		#define modinc(v) ((v + 1) % DrawPrimitive_Count)
-		while (emptyCount != DrawPrimitive_Count)
-		{
-			while (search[cprim] == 0)
+			if (i == 0)
 			{
-				cprim = modinc(cprim);
+				unlinkPages(list); // compacted in place
 			}
-
-		 // find the max key at the current position across all sort data
-			float mxkey = search[cprim]->m_key;
-			int mxprim = cprim;
-			for (int p = modinc(cprim); p != cprim; p = modinc(p))
+			else
 			{
-				if (search[p] != 0 && search[p]->m_key > mxkey)
-				{
-					mxkey = search[p]->m_key;
-					mxprim = p;
-				}
+				clearSortKeys(list);
 			}
-
-		 // if draw list is empty or the layer or primitive changed, start a new draw list
-			if (false
-				|| first
-				|| (m_drawLists.back().m_layerId  != m_layerIdMap[layer])
-				|| (m_drawLists.back().m_primType != mxprim)
-				)
+			const U32 vertsPerPrim = VertsPerDrawPrimitive[list % DrawPrimitive_Count];
+			for (U32 page = 0; page < getPageCount(i, list); ++page)
 			{
-				cprim = mxprim;
-				DrawList dl;
-				dl.m_layerId     = m_layerIdMap[layer];
-				dl.m_primType    = (DrawPrimitiveType)cprim;
-				dl.m_vertexData  = m_vertexData[1][layer * DrawPrimitive_Count + cprim]->data() + (search[cprim] - sortData[cprim].data()) * VertsPerDrawPrimitive[cprim];
-				dl.m_vertexCount = 0;
-				m_drawLists.push_back(dl);
-				first = false;
+				VertexList& vertexData = getPageVertexList(i, list, page);
+				#if IM3D_INDEXED_DRAW_LISTS
+					IndexList& indexData = getPageIndexList(i, list, page);
+					const U32 elementCount = indexData.size();
+					U32 dst = 0;
+					for (U32 e = 0; e < elementCount; e += vertsPerPrim, ++primIndex)
+					{
+						if (keep[primIndex])
+						{
+							for (U32 j = 0; j < vertsPerPrim; ++j)
+							{
+								indexData[dst++] = indexData[e + j];
+							}
+						}
+					}
+					removeCount += elementCount - dst;
+					indexData.resize(dst);
+
+				 // remove unreferenced vertices, preserving the submission order
+					Vector<U32>& remap = scratch.m_reorder;
+					remap.clear();
+					remap.resize(vertexData.size(), ~0u);
+					for (U32 index : indexData)
+					{
+						remap[index] = 0;
+					}
+					U32 vertexCount = 0;
+					for (U32 v = 0; v < vertexData.size(); ++v)
+					{
+						if (remap[v] != ~0u)
+						{
+							remap[v] = vertexCount;
+							vertexData[vertexCount++] = vertexData[v];
+						}
+					}
+					vertexData.resize(vertexCount);
+					for (U32& index : indexData)
+					{
+						index = remap[index];
+					}
+				#else
+					const U32 elementCount = vertexData.size();
+					U32 dst = 0;
+					for (U32 e = 0; e < elementCount; e += vertsPerPrim, ++primIndex)
+					{
+						if (keep[primIndex])
+						{
+							for (U32 j = 0; j < vertsPerPrim; ++j)
+							{
+								vertexData[dst++] = vertexData[e + j];
+							}
+						}
+					}
+					removeCount += elementCount - dst;
+					vertexData.resize(dst);
+				#endif
 			}
+		}
+	}
+	m_budgetStats.m_vertexCount -= removeCount < m_budgetStats.m_vertexCount ? removeCount : m_budgetStats.m_vertexCount;
+	m_budgetStats.m_droppedVertices += removeCount;
+}
 
-		 // increment the vertex count for the current draw list
-			m_drawLists.back().m_vertexCount += VertsPerDrawPrimitive[cprim];
-			++search[cprim];
-			if (search[cprim] == sortData[cprim].end())
+U32 Context::getLayerVertexCount(U32 _layer) const
+{
+	U32 ret = 0;
+	for (U32 i = 0; i < DrawPrimitive_Count; ++i)
+	{
+		for (U32 j = 0; j < 2; ++j)
+		{
+			const U32 list = _layer * DrawPrimitive_Count + i;
+			for (U32 page = 0; page < getPageCount(j, list); ++page)
 			{
-				search[cprim] = 0;
-				++emptyCount;
+				#if IM3D_INDEXED_DRAW_LISTS
+					ret += getPageIndexList(j, list, page).size();
+				#else
+					ret += getPageVertexList(j, list, page).size();
+				#endif
 			}
-
 		}
-		#undef modinc
 	}
-
-	m_sortCalled = true;
+	return ret;
 }
 
-int Context::findLayerIndex(Id _id) const
+void Context::insertLayerIndex(Id _id, U32 _index)
 {
-	for (int i = 0; i < (int)m_layerIdMap.size(); ++i)
+ // keep the load factor <= 1/2
+	if ((m_layerIdMap.size() * 2) > m_layerIdHash.size())
 	{
-		if (m_layerIdMap[i] == _id)
+		Vector<U32> hash;
+		hash.setAllocator(&m_allocator);
+		hash.resize(m_layerIdHash.empty() ? 16 : m_layerIdHash.size() * 2, 0);
+		Vector<U32>::swap(hash, m_layerIdHash);
+		for (U32 i = 0; i < m_layerIdMap.size(); ++i)
 		{
-			return i;
+			if (i != _index)
+			{
+				insertLayerIndex(m_layerIdMap[i], i);
+			}
 		}
 	}
-	return -1;
+	const U32 mask = m_layerIdHash.size() - 1;
+	U32 i = HashLayerId(_id) & mask;
+	while (m_layerIdHash[i] != 0)
+	{
+		i = (i + 1) & mask;
+	}
+	m_layerIdHash[i] = _index + 1;
 }
 
 bool Context::isVisible(const VertexData* _vdata, DrawPrimitiveType _prim)
 {
+	if (m_layerRetained)
+	{
+		return true; // retained data must be valid for any view
+	}
 	Vec3  pos[3];
 	float size[3];
 	for (int i = 0; i < VertsPerDrawPrimitive[_prim]; ++i)
@@ -2110,6 +5066,10 @@ bool Context::isVisible(const VertexData* _vdata, DrawPrimitiveType _prim)
 
 bool Context::isVisible(const Vec3& _origin, float _radius)
 {
+	if (m_layerRetained)
+	{
+		return true; // retained data must be valid for any view
+	}
 	for (int i = 0; i < m_cullFrustumCount; ++i)
 	{
 		const Vec4& plane = m_cullFrustum[i];
@@ -2123,6 +5083,10 @@ bool Context::isVisible(const Vec3& _origin, float _radius)
 
 bool Context::isVisible(const Vec3& _min, const Vec3& _max)
 {
+	if (m_layerRetained)
+	{
+		return true; // retained data must be valid for any view
+	}
 #if 0
  	const Vec3 points[] =
 		{
@@ -2188,6 +5152,13 @@ Context::TextList* Context::getCurrentTextList()
 	return m_textData[m_layerIndex];
 }
 
+#if IM3D_INDEXED_DRAW_LISTS
+Context::IndexList* Context::getCurrentIndexList()
+{
+	return m_indexData[m_vertexDataIndex][m_layerIndex * DrawPrimitive_Count + m_primType];
+}
+#endif
+
 float Context::pixelsToWorldSize(const Vec3& _position, float _pixels)
 {
 	float d = m_appData.m_projOrtho ? 1.0f : Length(_position - m_appData.m_viewOrigin);
@@ -2726,10 +5697,22 @@ void Context::resetId()
 U32 Context::getPrimitiveCount(DrawPrimitiveType _type) const
 {
 	U32 ret = 0;
-	for (U32 i = 0; i < m_layerIdMap.size(); ++i)
+	for (U32 i = 0; i < 2; ++i)
 	{
-		U32 j = i * DrawPrimitive_Count + _type;
-		ret += m_vertexData[0][j]->size() + m_vertexData[1][j]->size();
+		for (U32 j : m_activeLists[i])
+		{
+			if (j % DrawPrimitive_Count == (U32)_type)
+			{
+				for (U32 page = 0; page < getPageCount(i, j); ++page)
+				{
+					#if IM3D_INDEXED_DRAW_LISTS
+						ret += getPageIndexList(i, j, page).size();
+					#else
+						ret += getPageVertexList(i, j, page).size();
+					#endif
+				}
+			}
+		}
 	}
 	ret /= VertsPerDrawPrimitive[_type];
 
@@ -2739,7 +5722,7 @@ U32 Context::getPrimitiveCount(DrawPrimitiveType _type) const
 U32 Context::getTextCount() const
 {
 	U32 ret = 0;
-	for (U32 i = 0; i < m_layerIdMap.size(); ++i)
+	for (U32 i : m_activeTextLayers)
 	{
 		ret += m_textData[i]->size();
 	}
@@ -3281,4 +6264,5 @@ static void StaticAsserts()
 	IM3D_STATIC_ASSERT(alignof(Mat3) == alignof(float[9]));
 	IM3D_STATIC_ASSERT(sizeof (Mat4) == sizeof (float[16]));
 	IM3D_STATIC_ASSERT(alignof(Mat4) == alignof(float[16]));
+	IM3D_STATIC_ASSERT(sizeof (VertexDataCompact) == 16);
 }
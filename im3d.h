@@ -7,7 +7,7 @@
 #include "im3d_config.h"
 #endif
 
-#define IM3D_VERSION "1.16"
+#define IM3D_VERSION "1.17"
 
 #ifndef IM3D_API
 	#define IM3D_API
@@ -22,7 +22,24 @@
 	#define IM3D_VERTEX_ALIGNMENT 4
 #endif
 
+#ifndef IM3D_INDEXED_DRAW_LISTS
+	#define IM3D_INDEXED_DRAW_LISTS 0
+#endif
+
+#ifndef IM3D_VERTEX_COMPACT
+	#define IM3D_VERTEX_COMPACT 0
+#endif
+
+#ifndef IM3D_ALLOC_TRACKING
+	#define IM3D_ALLOC_TRACKING 0
+#endif
+
+#ifndef IM3D_VIRTUAL_MEMORY
+	#define IM3D_VIRTUAL_MEMORY 0
+#endif
+
 #include <cstdarg> // va_list
+#include <cstddef> // size_t
 
 namespace Im3d {
 
@@ -34,9 +51,19 @@ struct Mat3;
 struct Mat4;
 struct Color;
 struct VertexData;
+struct VertexDataCompact;
+#if IM3D_VERTEX_COMPACT // draw list vertex layout
+	typedef VertexDataCompact DrawVertexData;
+#else
+	typedef VertexData DrawVertexData;
+#endif
 struct AppData;
 struct DrawList;
 struct TextDrawList;
+struct FrameSnapshot;
+struct AllocStats;
+struct Budget;
+struct BudgetStats;
 struct Context;
 
 typedef U32 Id;
@@ -58,6 +85,18 @@ IM3D_API U32 GetDrawListCount();
 IM3D_API const TextDrawList* GetTextDrawLists();
 IM3D_API U32 GetTextDrawListCount();
 
+// Access the contiguous vertex/index data for the whole frame if AppData::m_contiguousDrawData is set (or IM3D_VERTEX_COMPACT
+// is enabled), else null/0. DrawList::m_vertexOffset/m_indexOffset locate each draw list within these buffers.
+IM3D_API const DrawVertexData* GetFrameVertexData();
+IM3D_API U32 GetFrameVertexCount();
+IM3D_API const U32* GetFrameIndexData();
+IM3D_API U32 GetFrameIndexCount();
+
+// Return the most recently published frame if AppData::m_frameSnapshots is set, else null (or if no frame was published yet).
+// The snapshot is immutable and stays valid until the next call, i.e. another thread may consume it while the next frame is
+// recorded. Call from one consumer thread at a time.
+IM3D_API const FrameSnapshot* AcquireFrameSnapshot();
+
 // DEPRECATED (use EndFrame() + GetDrawLists()).
 // Call after all Im3d calls have been made for the current frame.
 IM3D_API void Draw();
@@ -82,6 +121,12 @@ IM3D_API void Vertex(float _x, float _y, float _z, Color _color);
 IM3D_API void Vertex(float _x, float _y, float _z, float _size);
 IM3D_API void Vertex(float _x, float _y, float _z, float _size, Color _color);
 
+// Add _count vertices to the current primitive (call between Begin*() and End()), equivalent to calling Vertex() _count times.
+// _sizes/_colors may be null, in which case the current size/color draw state is used.
+IM3D_API void Vertices(const Vec3* _positions, U32 _count);
+IM3D_API void Vertices(const Vec3* _positions, const Color* _colors, U32 _count);
+IM3D_API void Vertices(const Vec3* _positions, const float* _sizes, const Color* _colors, U32 _count);
+
 // Color draw state (per vertex).
 IM3D_API void PushColor(); // push the stack top
 IM3D_API void PushColor(Color _color);
@@ -171,6 +216,24 @@ IM3D_API void PushLayerId(const char* _str); // calls PushLayerId(MakeId(_str))
 IM3D_API void PopLayerId();
 IM3D_API Id   GetLayerId();
 
+// Layer enable state, persists across frames. Begin*()/Vertex()/Text()/Draw*() calls into a disabled layer don't record any data
+// (draw lists are still generated for data recorded earlier in the frame, retained data is hidden). Layers are enabled by default.
+IM3D_API void SetLayerEnabled(Id _layer, bool _enable);
+IM3D_API bool IsLayerEnabled(Id _layer);
+IM3D_API bool IsLayerEnabled(); // current layer
+
+// Retained layers keep their primitives across NewFrame() until invalidated, e.g. for static geometry which is expensive to
+// generate. A retained layer is recorded during the first frame after SetLayerRetained()/InvalidateLayer(); once recorded,
+// subsequent Begin*()/Vertex()/Text()/Draw*() calls into the layer return immediately. Culling is disabled while recording.
+IM3D_API void SetLayerRetained(Id _layer, bool _retain);
+IM3D_API void InvalidateLayer(Id _layer); // discard retained primitives, the layer will be recorded again
+IM3D_API bool IsLayerRecording(); // false if the current layer is disabled or retained and already recorded, use to skip expensive data walks
+
+// Layer budget, persists across frames (see Budget). AppData::m_budget limits the whole context. Pass Budget() to remove.
+IM3D_API void SetLayerBudget(Id _layer, const Budget& _budget);
+// Data recorded and dropped by budgets during the current frame.
+IM3D_API const BudgetStats& GetBudgetStats();
+
 // Manipulate translation/rotation/scale via a gizmo. Return true if the gizmo is 'active' (if it modified the output parameter).
 // If _local is true, the Gizmo* functions expect that the local matrix is on the matrix stack; in general the application should
 // push the local matrix before calling any of the following.
@@ -201,8 +264,18 @@ IM3D_API bool IsVisible(const Vec3& _min, const Vec3& _max); // axis-aligned bou
 IM3D_API Context& GetContext();
 IM3D_API void SetContext(Context& _ctx);
 
-// Merge vertex data from _src into _dst_. Layers are preserved. Call before EndFrame().
+// Merge vertex data from _src into _dst_. Layers are preserved. Call before EndFrame(). If AppData::m_mergeLinked is set for
+// _dst_, unsorted data is referenced rather than copied: _src must not be modified (or call NewFrame()) until _dst_'s draw
+// data was consumed.
 IM3D_API void MergeContexts(Context& _dst_, const Context& _src);
+// As above for _count sources (in order), _dst_ is sized once and the sources are copied via AppData::parallelForCallback if set.
+IM3D_API void MergeContexts(Context& _dst_, const Context* const* _srcs, U32 _count);
+// Sort the current context's sorted primitives by AppData::m_viewOrigin prior to MergeContexts(), e.g. on the thread which
+// recorded them. Presorted data is merged into the destination's order rather than sorted again (if m_viewOrigin is the same).
+IM3D_API void PresortForMerge();
+
+// Allocation stats for the current context, see AllocStats. Requires IM3D_ALLOC_TRACKING (else all zero).
+IM3D_API const AllocStats& GetAllocStats();
 
 
 struct IM3D_API Vec2
@@ -432,6 +505,13 @@ struct alignas(IM3D_VERTEX_ALIGNMENT) VertexData
 	VertexData(const Vec3& _position, float _size, Color _color): m_positionSize(_position, _size), m_color(_color) {}
 };
 
+// Draw list vertex layout if IM3D_VERTEX_COMPACT is enabled.
+struct VertexDataCompact
+{
+	Vec3   m_position;
+	U32    m_colorSize;    // rgba6 (MSB = r), size in 1/2 pixel units (8 LSBs). Sizes above 127.5 pixels are clamped.
+};
+
 enum DrawPrimitiveType
 {
  // order here determines the order in which unsorted primitives are drawn
@@ -444,12 +524,81 @@ enum DrawPrimitiveType
 
 struct DrawList
 {
-	Id                m_layerId;
-	DrawPrimitiveType m_primType;
-	const VertexData* m_vertexData;
-	U32               m_vertexCount;
+	Id                    m_layerId;
+	DrawPrimitiveType     m_primType;
+	const DrawVertexData* m_vertexData;  // VertexData, or VertexDataCompact if IM3D_VERTEX_COMPACT is enabled.
+	U32                   m_vertexCount;
+	const U32*            m_indexData;   // If not null, draw m_indexCount indices into m_vertexData (see IM3D_INDEXED_DRAW_LISTS, AppData::m_sortIndexed), else draw m_vertexCount vertices.
+	U32                   m_indexCount;
+	U32                   m_vertexOffset;  // Offset of m_vertexData in GetFrameVertexData() (if not null), i.e. the base vertex.
+	U32                   m_indexOffset;   // Offset of m_indexData in GetFrameIndexData() (if not null).
 };
 typedef void (DrawPrimitivesCallback)(const DrawList& _drawList);
+// Call _task(i, _taskData) for i in [0, _count), possibly concurrently, return when all calls returned.
+typedef void (ParallelForCallback)(U32 _count, void (*_task)(U32 _index, void* _taskData), void* _taskData);
+
+// App-provided vertex memory (see Context::setVertexStorage()), e.g. a persistently mapped upload buffer. Vertex data is
+// written directly to memory returned by the callbacks and draw lists point into it, so no copy is required prior to
+// upload. Memory is owned by the app; Im3d drops all references to it during NewFrame().
+struct VertexStorage
+{
+	// Return at least _size bytes, aligned to IM3D_VERTEX_ALIGNMENT (null = fall back to internal memory).
+	void* (*m_allocate)(U32 _size, void* _userData)                           = nullptr;
+	// Return at least _size bytes containing the first _usedSize bytes of _data, may return _data if the block can grow
+	// in place (null = try m_allocate() + copy). Optional.
+	void* (*m_grow)(void* _data, U32 _usedSize, U32 _size, void* _userData)   = nullptr;
+	// Called during EndFrame() for each block with the final # bytes written (e.g. to flush a non-coherent mapping). Optional.
+	void  (*m_commit)(void* _data, U32 _size, void* _userData)                = nullptr;
+	void*   m_userData                                                         = nullptr;
+};
+
+// App-provided allocator for all memory owned by a Context, see Context(const Allocator&). Null callbacks = IM3D_MALLOC/IM3D_FREE.
+struct Allocator
+{
+	void* (*m_allocate)(size_t _size, void* _userData) = nullptr;
+	void  (*m_free)(void* _ptr, void* _userData)       = nullptr;
+	void*   m_userData                                  = nullptr;
+};
+
+// Heap allocations made by a Context, see GetAllocStats(). Requires IM3D_ALLOC_TRACKING. Memory from VertexStorage,
+// virtual memory (IM3D_VIRTUAL_MEMORY) and the frame arena (AppData::m_frameArena) isn't counted, except for growing the arena itself.
+struct AllocStats
+{
+	U32    m_allocCount       = 0; // # allocations since the Context was created.
+	U32    m_freeCount        = 0; // # frees since the Context was created.
+	size_t m_allocBytes       = 0; // Total bytes allocated since the Context was created.
+	size_t m_liveBytes        = 0; // Bytes currently allocated.
+	size_t m_peakBytes        = 0; // Max m_liveBytes.
+	U32    m_frameAllocCount  = 0; // # allocations since the last NewFrame().
+	size_t m_frameAllocBytes  = 0; // Bytes allocated since the last NewFrame().
+};
+
+enum BudgetPolicy
+{
+	BudgetPolicy_DropNew,     // Drop primitives/text which don't fit.
+	BudgetPolicy_DropLayer,   // Drop everything recorded into the layer for the rest of the frame (for AppData::m_budget, the layer being recorded).
+	BudgetPolicy_KeepNearest  // Keep the primitives nearest to AppData::m_viewOrigin (up to 2x m_maxVertices is used while recording). Text is dropped as BudgetPolicy_DropNew.
+};
+
+// Per-frame limits on the data recorded into a Context or a layer, see AppData::m_budget and SetLayerBudget(). Memory is
+// bounded by m_maxVertices * sizeof(VertexData) (+ an index each if IM3D_INDEXED_DRAW_LISTS) plus m_maxTextBytes. Primitives
+// are dropped whole; data added via MergeContexts() is counted but only limited by BudgetPolicy_KeepNearest.
+struct Budget
+{
+	U32          m_maxVertices  = 0;                    // Draw list vertices (indices if IM3D_INDEXED_DRAW_LISTS), all primitive types. 0 = unlimited.
+	U32          m_maxTextBytes = 0;                    // Text characters, including terminators. 0 = unlimited.
+	BudgetPolicy m_policy       = BudgetPolicy_DropNew;
+};
+
+// Data recorded/dropped since the last NewFrame(), see GetBudgetStats().
+struct BudgetStats
+{
+	U32 m_vertexCount     = 0; // Vertices (indices if IM3D_INDEXED_DRAW_LISTS) recorded, excluding dropped data.
+	U32 m_textBytes       = 0; // Text bytes recorded, excluding dropped text.
+	U32 m_droppedVertices = 0; // Vertices discarded or rejected by a budget.
+	U32 m_droppedText     = 0; // Text() calls discarded or rejected by a budget.
+	U32 m_droppedLayers   = 0; // Layers dropped by BudgetPolicy_DropLayer.
+};
 
 enum TextFlags
 {
@@ -478,6 +627,20 @@ struct TextDrawList
 	const char*     m_textBuffer;
 };
 
+// Draw data for one frame, see AcquireFrameSnapshot(). Vertex/index data is contiguous, as for GetFrameVertexData().
+struct FrameSnapshot
+{
+	const DrawList*       m_drawLists          = nullptr;
+	U32                   m_drawListCount      = 0;
+	const TextDrawList*   m_textDrawLists      = nullptr;
+	U32                   m_textDrawListCount  = 0;
+	const DrawVertexData* m_vertexData         = nullptr;
+	U32                   m_vertexCount        = 0;
+	const U32*            m_indexData          = nullptr;
+	U32                   m_indexCount         = 0;
+	U32                   m_frameIndex         = 0; // # calls to NewFrame() before the frame was recorded.
+};
+
 enum Key
 {
 	Mouse_Left,
@@ -527,9 +690,24 @@ struct AppData
 	float  m_snapRotation                    = 0.0f;                    // Snap value for rotation gizmos (radians). 0 = disabled.
 	float  m_snapScale                       = 0.0f;                    // Snap value for scale gizmos. 0 = disabled.
 	bool   m_flipGizmoWhenBehind             = true;                    // Flip gizmo axes when viewed from behind.
+	bool   m_contiguousDrawData              = false;                   // Pack all draw list vertex/index data into single buffers during EndFrame(), see GetFrameVertexData().
+	U32    m_drawDataAlignment               = 0;                       // Alignment (bytes, power of 2) of each draw list within the contiguous buffers, e.g. for binding buffer ranges.
+	bool   m_sortIncremental                 = false;                   // Seed sorting with the previous frame's order, faster if the same primitives are submitted in the same order each frame and the view changes smoothly.
+	bool   m_sortIndexed                     = false;                   // Sorted draw lists index into vertex data in submission order (DrawList::m_indexData) instead of reordering it. Always true if IM3D_INDEXED_DRAW_LISTS.
+	bool   m_frameSnapshots                  = false;                   // EndFrame() publishes the draw data as a FrameSnapshot (triple buffered), see AcquireFrameSnapshot(). GetDrawLists() etc. are empty. Implies m_contiguousDrawData, m_frameArena is ignored.
+	bool   m_mergeLinked                     = false;                   // MergeContexts() into this context references the source's unsorted vertex data instead of copying it (except for retained layers), draw lists point into the source.
+	bool   m_frameArena                      = false;                   // Allocate transient per-frame data (draw lists, text, frame offsets) from a linear allocator which is reset during NewFrame().
+	size_t m_vertexListReserve               = 0;                       // Reserve this many bytes of address space per vertex list and commit memory on demand, so that lists grow in place without copying (IM3D_VIRTUAL_MEMORY only). 0 = heap.
+	size_t m_vertexListKeep                  = 0;                       // Committed memory per vertex list above this many bytes is returned to the OS during NewFrame() (IM3D_VIRTUAL_MEMORY only). 0 = never.
+	bool   m_vertexListHugePages             = false;                   // Request transparent huge pages for m_vertexListReserve (MADV_HUGEPAGE, if available).
+	U32    m_vertexPageSize                  = 0;                       // Split unsorted vertex lists into pages of ~this many vertices (or indices) so that growing a list never copies it (except within a strip/loop, or while a vertex budget applies). Draw lists are split per page unless the frame data is packed. 0 = never.
+	U32    m_layerMaxUnusedFrames            = 0;                       // Free layers which weren't pushed for this many frames (checked every N frames, except disabled/retained layers). 0 = never.
+	U32    m_allocWarmupFrames               = 0;                       // Assert if the context allocates after this many frames (IM3D_ALLOC_TRACKING only). 0 = never.
+	Budget m_budget;                                                    // Per-frame limits for the whole context (all layers), see Budget.
 	void*  m_appData                         = nullptr;                 // App-specific data.
 
 	DrawPrimitivesCallback* drawCallback     = nullptr; // e.g. void Im3d_Draw(const DrawList& _drawList)
+	ParallelForCallback*    parallelForCallback = nullptr; // e.g. a job system's parallel for, used by MergeContexts() for multiple sources. Null = serial.
 
 	// Extract cull frustum planes from the view-projection matrix.
 	// Set _ndcZNegativeOneToOne = true if the proj matrix maps z from [-1,1] (OpenGL style).
@@ -574,11 +752,45 @@ struct Vector
 
 	static void swap(Vector<T>& _a_, Vector<T>& _b_);
 
+	// Allocate via _storage (if not null) on subsequent calls to reserve().
+	void        setStorage(const VertexStorage* _storage) { m_storage = _storage; }
+	// If the data was allocated via a VertexStorage.
+	bool        isExternal() const                   { return m_external; }
+	// Free (or drop, if external) the data.
+	void        release();
+	// Reference _size elements at _data without copying or taking ownership (as external data). The data is never written,
+	// growing copies it to new memory.
+	void        reference(const T* _data, U32 _size);
+
+	// Allocate internal memory via _allocator (null = IM3D_MALLOC/IM3D_FREE), call before any internal memory is allocated.
+	void        setAllocator(const Allocator* _allocator) { IM3D_ASSERT(m_data == nullptr || m_external); m_allocator = _allocator; }
+	const Allocator* getAllocator() const            { return m_allocator; }
+
+	#if IM3D_VIRTUAL_MEMORY
+	// Reserve _size bytes of address space on the next reserve() and commit it on demand, so that growing never copies (0 = heap).
+	void        setVirtual(size_t _size, bool _hugePages) { m_virtualReserve = _size; m_virtualHugePages = _hugePages; }
+	// Decommit memory above _size bytes (or size(), if larger). Releases the reservation if unused or if setVirtual() changed and the vector is empty.
+	void        trimVirtual(size_t _size);
+	#endif
+
 private:
 
 	T*   m_data     = nullptr;
 	U32  m_size     = 0;
 	U32  m_capacity = 0;
+	const VertexStorage* m_storage = nullptr;
+	const Allocator*     m_allocator = nullptr;
+	bool m_external = false;
+	#if IM3D_VIRTUAL_MEMORY
+	char*  m_virtual          = nullptr; // Reserved address range, m_data if in use.
+	size_t m_virtualSize      = 0;       // Bytes reserved at m_virtual.
+	size_t m_virtualCommitted = 0;       // Bytes committed at the start of m_virtual.
+	size_t m_virtualReserve   = 0;       // See setVirtual().
+	bool   m_virtualHugePages = false;
+
+	// Commit at least _size bytes of the reservation (reserve first if required), return null if it doesn't fit.
+	T*          commitVirtual(size_t _size);
+	#endif
 };
 
 
@@ -603,6 +815,7 @@ enum GizmoMode
 struct IM3D_API Context
 {
 	                    Context();
+	                    Context(const Allocator& _allocator); // all memory owned by the Context is allocated via _allocator
 	                    ~Context();
 
 	void                begin(PrimitiveMode _mode);
@@ -610,21 +823,41 @@ struct IM3D_API Context
 
 	void                vertex(const Vec3& _position, float _size, Color _color);
 	void                vertex(const Vec3& _position )   { vertex(_position, getSize(), getColor()); }
+	void                vertices(const Vec3* _positions, const float* _sizes, const Color* _colors, U32 _count); // _sizes/_colors may be null
 
 	void                text(const Vec3& _position, float _size, Color _color, TextFlags _flags, const char* _textStart, const char* _textEnd);
 	void                text(const Vec3& _position, float _size, Color _color, TextFlags _flags, const char* _text, va_list _args);
 
 	void                reset();
 	void                merge(const Context& _src);
+	void                merge(const Context* const* _srcs, U32 _count);
+	void                presortForMerge();
 	void                endFrame();
 	void                draw(); // DEPRECATED (see Im3d::Draw)
 
+	// Write vertex data to app-provided memory, see VertexStorage. Call before reset(). Pass VertexStorage() to revert to internal memory.
+	void                setVertexStorage(const VertexStorage& _storage) { m_vertexStorage = _storage; }
+	const VertexStorage& getVertexStorage() const        { return m_vertexStorage; }
+
 	const DrawList*     getDrawLists() const             { return m_drawLists.data(); }
 	U32                 getDrawListCount() const         { return m_drawLists.size(); }
 
 	const TextDrawList* getTextDrawLists() const         { return m_textDrawLists.data();  }
 	U32                 getTextDrawListCount() const     { return m_textDrawLists.size();  }
 
+	const DrawVertexData* getFrameVertexData() const     { return m_frameVertexData.empty() ? nullptr : m_frameVertexData.data(); }
+	U32                 getFrameVertexCount() const      { return m_frameVertexData.size(); }
+	#if IM3D_INDEXED_DRAW_LISTS
+	const U32*          getFrameIndexData() const        { return m_frameIndexData.empty() ? nullptr : m_frameIndexData.data(); }
+	U32                 getFrameIndexCount() const       { return m_frameIndexData.size(); }
+	#else
+	const U32*          getFrameIndexData() const        { return (m_frameDataPacked && !m_sortedIndexData.empty()) ? m_sortedIndexData.data() : nullptr; }
+	U32                 getFrameIndexCount() const       { return m_frameDataPacked ? m_sortedIndexData.size() : 0; }
+	#endif
+
+	// See AcquireFrameSnapshot(), may be called from another thread.
+	const FrameSnapshot* acquireFrameSnapshot();
+
 
 	void                setColor(Color _color)           { m_colorStack.back() = _color;   }
 	Color               getColor() const                 { return m_colorStack.back();     }
@@ -650,6 +883,20 @@ struct IM3D_API Context
 	void                pushLayerId(Id _layer);
 	void                popLayerId();
 
+	// Enable/disable recording for _layer (persists across frames). Draw calls into a disabled layer return immediately.
+	void                setLayerEnabled(Id _layer, bool _enable);
+	bool                isLayerEnabled(Id _layer) const;
+	bool                isLayerEnabled() const           { return (m_layerFlags[m_layerIndex] & LayerFlags_Disabled) == 0; } // current layer
+
+	// Retain _layer across reset() until invalidateLayer() is called (or the layer is no longer retained).
+	void                setLayerRetained(Id _layer, bool _retain);
+	void                invalidateLayer(Id _layer);
+	bool                isLayerRecording() const         { return m_layerRecording; } // current layer accepts new primitives
+
+	// Limit the data recorded into _layer per frame (persists across frames), see Budget.
+	void                setLayerBudget(Id _layer, const Budget& _budget);
+	const BudgetStats&  getBudgetStats() const           { return m_budgetStats; }
+
 	void                setMatrix(const Mat4& _mat4)     { m_matrixStack.back() = _mat4;   }
 	const Mat4&         getMatrix() const                { return m_matrixStack.back();    }
 	void                pushMatrix(const Mat4& _mat4)    { m_matrixStack.push_back(_mat4); }
@@ -727,6 +974,9 @@ struct IM3D_API Context
 	// Return the number of layers.
 	U32                 getLayerCount() const { return m_layerIdMap.size(); }
 
+	// Return the allocation stats (requires IM3D_ALLOC_TRACKING).
+	const AllocStats&   getAllocStats() const { return m_allocStats; }
+
 private:
 
  // State stacks.
@@ -742,23 +992,145 @@ private:
 	typedef Vector<VertexData> VertexList;
 	Vector<VertexList*> m_vertexData[2];                    // Each layer is DrawPrimitive_Count consecutive lists.
 	int                 m_vertexDataIndex;                  // 0, or 1 if sorting enabled.
+	#if IM3D_INDEXED_DRAW_LISTS
+	typedef Vector<U32> IndexList;
+	Vector<IndexList*>  m_indexData[2];                     // Parallel to m_vertexData.
+	#endif
+	Vector<Vector<U32>*> m_sortOrder;                       // Parallel to m_vertexData[1], previous frame's primitive order if AppData::m_sortIncremental.
+	Vector<U32>         m_activeLists[2];                   // Indices into m_vertexData which may be non-empty (written this frame or retained), see markListActive().
+ // Unsorted lists which exceed AppData::m_vertexPageSize are moved to a page at the next Begin*(), or at the next point/line/triangle
+ // within a Begin*()/End() (see splitPrimitive()). The list itself is always the last page. A primitive never spans pages, strips and
+ // loops are only split at Begin*(). Sorted lists aren't paged, sort() rewrites them each frame.
+	struct VertexPage
+	{
+		VertexList      m_vertexData;
+		#if IM3D_INDEXED_DRAW_LISTS
+		IndexList       m_indexData;                        // Indexes m_vertexData.
+		#endif
+		bool            m_linked = false;                   // References another context's list, see linkPage().
+	};
+	Vector<VertexPage*> m_vertexPagesFree;                  // Unused pages (with their buffers), allocated on demand by sealPage().
+	Vector<VertexPage*> m_linkedPagesFree;                  // Unused linked pages (without buffers).
+	Vector<bool>        m_listActive[2];                    // Parallel to m_vertexData, if the list is in m_activeLists.
 	Vector<Id>          m_layerIdMap;                       // Map Id -> vertex data index.
+	Vector<U32>         m_layerIdHash;                      // Open addressing hash table (linear probing) for findLayerIndex(), = index in m_layerIdMap + 1, 0 = empty.
 	int                 m_layerIndex;                       // Index of the currently active layer in m_layerIdMap.
+	Vector<U32>         m_layerFlags;                       // Parallel to m_layerIdMap, LayerFlags_ bits.
+	bool                m_layerRecording;                   // Current layer accepts new primitives, see updateLayerState().
+	bool                m_layerRetained;                    // Current layer is retained (culling disabled).
 	Vector<DrawList>    m_drawLists;                        // All draw lists for the current frame, available after calling endFrame() before calling reset().
 	bool                m_sortCalled;                       // Avoid calling sort() during every call to draw().
 	bool                m_endFrameCalled;                   // For assert, if vertices are pushed after endFrame() was called.
+	VertexStorage       m_vertexStorage;                    // If m_allocate is set, draw list vertex data is allocated via m_vertexStorage.
+	bool                m_frameDataPacked;                  // If draw lists point into m_frameVertexData (AppData::m_contiguousDrawData or IM3D_VERTEX_COMPACT).
+	Vector<DrawVertexData> m_frameVertexData;               // All vertex data packed (and converted if IM3D_VERTEX_COMPACT) during endFrame().
+	Vector<U32>         m_frameVertexOffsets;               // Offset of each list in m_frameVertexData, sorted lists follow unsorted lists.
+	#if IM3D_INDEXED_DRAW_LISTS
+	Vector<U32>         m_frameIndexData;                   // As m_frameVertexData.
+	Vector<U32>         m_frameIndexOffsets;                //               "
+	#else
+	Vector<U32>         m_sortedIndexData;                  // Sorted draw list indices if AppData::m_sortIndexed, all layers.
+	#endif
 
  // Text data: one list per layer.
 	typedef Vector<TextData> TextList;
 	Vector<TextList*>    m_textData;
+	Vector<U32>          m_activeTextLayers;                // Layers whose text list may be non-empty (LayerFlags_TextActive).
 	Vector<char>         m_textBuffer;
 	Vector<TextDrawList> m_textDrawLists;
+	Vector<TextData>     m_frameTextData;                   // Text draw lists point here if AppData::m_frameSnapshots (the per-layer lists change during the next frame).
+
+ // Frame snapshots, see AppData::m_frameSnapshots.
+	struct FrameSnapshots;
+	FrameSnapshots*      m_frameSnapshots;                  // Allocated by the constructor, acquireFrameSnapshot() may be called from another thread at any time.
+
+ // Layer storage: the per-layer lists above point into blocks of kLayerBlockSize LayerLists, allocated on demand by pushLayerId().
+	struct LayerLists
+	{
+		VertexList      m_vertexData[2][DrawPrimitive_Count];
+		#if IM3D_INDEXED_DRAW_LISTS
+		IndexList       m_indexData[2][DrawPrimitive_Count];
+		#endif
+		Vector<U32>     m_sortOrder[DrawPrimitive_Count];
+		TextList        m_textData;
+		Budget          m_budget;                           // See setLayerBudget().
+		U32             m_textBytes;                        // Text bytes recorded this frame.
+
+		void setAllocator(const Allocator* _allocator);
+	};
+	enum { kLayerBlockSize = 64 };
+	Vector<LayerLists*>  m_layerBlocks;
+	Vector<LayerLists*>  m_layerLists;                      // Parallel to m_layerIdMap.
+	Vector<LayerLists*>  m_layerListsFree;                  // Unused LayerLists, pushLayerId() allocates a new block when empty.
+
+ // Presort/paging state per list, most lists never need it so it's kept out of LayerLists and allocated on demand by getListState().
+	struct ListState
+	{
+		Vector<float>       m_sortKeys;                     // Sort key per primitive of m_vertexData[1] if it's presorted (see presortForMerge()) or was merged from presorted lists.
+		Vector<U32>         m_sortRuns;                     // End of each sorted run in m_sortKeys (merged lists only).
+		Vector<VertexPage*> m_vertexPages;                  // Full pages of m_vertexData[0], in order (see VertexPage).
+	};
+	Vector<ListState*>   m_listState;                       // Parallel to m_sortOrder, nullptr until getListState().
+	Vector<ListState*>   m_listStateFree;                   // Returned by collectLayers().
+	Vector<U32>          m_layerLastUsed;                   // Parallel to m_layerIdMap, m_frameIndex when the layer was last pushed.
+	Vector<U32>          m_usedLayers;                      // Layers pushed since the last reset() (LayerFlags_Used).
+	U32                  m_frameIndex;                      // Incremented by reset().
+	Vector<U32>          m_droppedLayers;                   // Layers with LayerFlags_Dropped, cleared by reset().
+	BudgetStats          m_budgetStats;
+
+ // Memory.
+	Allocator            m_allocator;                       // All Context-owned memory is allocated via m_allocator.
+	VertexStorage        m_frameArenaStorage;               // Allocates from m_frameArena, see AppData::m_frameArena.
+	char*                m_frameArena;                      // Linear allocator for transient per-frame data, reset by reset().
+	U32                  m_frameArenaSize;
+	U32                  m_frameArenaUsed;
+	U32                  m_frameArenaLast;                  // Offset of the last allocation, which can grow in place.
+	U32                  m_frameArenaRequired;              // Bytes requested this frame (including requests which didn't fit), the arena grows to fit during reset().
+	struct SortScratch;
+	SortScratch*         m_sortScratch;                     // Persistent scratch memory for sort(), allocated on first use.
+	AllocStats           m_allocStats;
+	#if IM3D_ALLOC_TRACKING
+	Allocator            m_appAllocator;                    // m_allocator counts allocations then forwards to m_appAllocator.
+	#endif
+	Vector<char>         m_textBufferScratch;               // Retained text is compacted here during reset().
+
+ // Merge: merge() sizes the destination lists then records one MergeCopy per source page, copied by MergeTask().
+	struct MergeList
+	{
+		U32             m_vertexCount;                      // Vertices still to be copied into the list.
+		#if IM3D_INDEXED_DRAW_LISTS
+		U32             m_indexCount;                       //      "
+		#endif
+		bool            m_touched;                          // If the list was sized.
+	};
+	struct MergeCopy
+	{
+		const VertexData* m_src;
+		VertexData*     m_dst;
+		U32             m_count;
+		#if IM3D_INDEXED_DRAW_LISTS
+		const U32*      m_srcIndices;
+		U32*            m_dstIndices;
+		U32             m_indexCount;
+		U32             m_indexOffset;                      // Added to each index.
+		#endif
+	};
+	Vector<MergeList>    m_mergeLists;                      // Per sorted/unsorted list, [_sorted * list count + list].
+	Vector<MergeCopy>    m_mergeCopies;
+	Vector<U32>          m_mergeTasks;                      // First MergeCopy per source, + end.
+	Vec3                 m_presortOrigin;                   // View origin of ListState::m_sortKeys, set by presortForMerge()/mergeSortRun().
 
  // Primitive state.
 	PrimitiveMode       m_primMode;
 	DrawPrimitiveType   m_primType;
 	U32                 m_firstVertThisPrim;                // Index of the first vertex pushed during this primitive.
 	U32                 m_vertCountThisPrim;                // # calls to vertex() since the last call to begin().
+	#if IM3D_INDEXED_DRAW_LISTS
+	U32                 m_firstIndexThisPrim;               // Index of the first index pushed during this primitive; m_vertCountThisPrim counts indices.
+	#endif
+	U32                 m_primVertexBudget;                 // Max m_vertCountThisPrim before the primitive is dropped, see updatePrimBudget().
+	bool                m_primBudgetLayer;                  // If m_primVertexBudget is limited by the layer budget, else AppData::m_budget.
+	U32                 m_primPageSize;                     // Split the primitive once the current list reaches this size, ~0u = never (see splitPrimitive()).
 	Vec3                m_minVertThisPrim;
 	Vec3                m_maxVertThisPrim;
 
@@ -772,12 +1144,128 @@ private:
 	// Sort primitive data.
 	void                sort();
 
+	// Return the draw list vertex/index data for m_vertexData[_sorted][_list] and its offset in the frame data (if packed).
+	const DrawVertexData* getDrawVertexData(int _sorted, U32 _list) const;
+	U32                 getFrameVertexOffset(int _sorted, U32 _list) const;
+	#if IM3D_INDEXED_DRAW_LISTS
+	const U32*          getDrawIndexData(int _sorted, U32 _list) const;
+	U32                 getFrameIndexOffset(int _sorted, U32 _list) const;
+	#endif
+
+	// Move the frame data to the back snapshot and publish it, the context gets the buffers of an older snapshot.
+	void                publishFrameSnapshot();
+	// If transient data is allocated from the frame arena (see AppData::m_frameArena).
+	bool                isFrameArenaEnabled() const      { return m_appData.m_frameArena && !m_appData.m_frameSnapshots; }
+	// Pack vertex/index data into m_frameVertexData/m_frameIndexData, call after sort().
+	void                packFrameData();
+
+	// Presort/paging state of list _list, getListState() allocates it if required.
+	ListState&          getListState(U32 _list);
+	const ListState*    findListState(U32 _list) const   { return m_listState[_list]; }
+	// Access the pages of m_vertexData[_sorted][_list] (see VertexPage), the last page is the list itself.
+	U32                 getPageCount(int _sorted, U32 _list) const;
+	VertexList&         getPageVertexList(int _sorted, U32 _list, U32 _page) const;
+	#if IM3D_INDEXED_DRAW_LISTS
+	IndexList&          getPageIndexList(int _sorted, U32 _list, U32 _page) const;
+	#endif
+	// Move unsorted list _list to a new page if it's full, or if adding _count vertices (or indices) would exceed AppData::m_vertexPageSize.
+	void                sealPage(U32 _list, U32 _count);
+	// Seal the current list at a primitive boundary within Begin*()/End() (PrimitiveMode_Points/Lines/Triangles only), see m_primPageSize.
+	void                splitPrimitive();
+	// Write _count vertices into the current list (see vertices()), _sizes/_colors are read with _sizeStride/_colorStride (0 = repeat the first).
+	void                appendVertices(const Vec3* _positions, const float* _sizes, U32 _sizeStride, const Color* _colors, U32 _colorStride, U32 _count);
+	// Return the pages of unsorted list _list to m_vertexPagesFree/m_linkedPagesFree.
+	void                releasePages(U32 _list);
+	// Append a page to unsorted list _list which references _vertexData/_indexData (see AppData::m_mergeLinked).
+	#if IM3D_INDEXED_DRAW_LISTS
+	void                linkPage(U32 _list, const VertexList& _vertexData, const IndexList& _indexData);
+	#else
+	void                linkPage(U32 _list, const VertexList& _vertexData);
+	#endif
+	// Copy the data of linked pages of unsorted list _list, e.g. before modifying it.
+	void                unlinkPages(U32 _list);
+	bool                isPageLinked(int _sorted, U32 _list, U32 _page) const;
+	// Pop a page from _free_ or allocate a new one.
+	VertexPage*         allocPage(Vector<VertexPage*>& _free_);
+
+	// Index of the layer/list which receives _src's layer _layer/list _list during merge(), or -1 if skipped.
+	int                 findMergeLayer(const Context& _src, U32 _layer) const;
+	int                 findMergeList(const Context& _src, U32 _list) const;
+	// If merge() links (rather than copies) _vertexData into m_vertexData[_sorted][_list], see AppData::m_mergeLinked.
+	bool                isMergeLinked(int _sorted, U32 _list, const VertexList& _vertexData) const;
+	// Append the sort keys of _src's sorted list _srcList to _dstList as a new run if both are presorted (_dstCount = # vertices
+	// or indices in _dstList before the merge), else invalidate the keys of _dstList.
+	void                mergeSortRun(const Context& _src, U32 _srcList, U32 _dstList, U32 _dstCount);
+	// Drop the sort keys of sorted list _list, e.g. if the list was modified.
+	void                clearSortKeys(U32 _list);
+	// ParallelForCallback task: copy the data of source _index, _taskData is the Context.
+	static void         MergeTask(U32 _index, void* _taskData);
+
+	// Drop all references to the frame arena, reset (and grow if required) then set the storage for transient data.
+	void                resetFrameArena();
+	// VertexStorage callbacks for m_frameArenaStorage, _userData is the Context.
+	static void*        FrameArenaAllocate(U32 _size, void* _userData);
+	static void*        FrameArenaGrow(void* _data, U32 _usedSize, U32 _size, void* _userData);
+	#if IM3D_ALLOC_TRACKING
+	// Allocator callbacks for m_allocator, _userData is the Context.
+	static void*        TrackedAllocate(size_t _size, void* _userData);
+	static void         TrackedFree(void* _ptr, void* _userData);
+	#endif
+
+	enum LayerFlags_
+	{
+		LayerFlags_Disabled   = 1 << 0, // setLayerEnabled(false).
+		LayerFlags_Retained   = 1 << 1, // setLayerRetained(true).
+		LayerFlags_Recorded   = 1 << 2, // Retained layer data was kept by reset().
+		LayerFlags_Used       = 1 << 3, // Layer was pushed since the last reset().
+		LayerFlags_TextActive = 1 << 4, // Layer is in m_activeTextLayers.
+		LayerFlags_Budget     = 1 << 5, // setLayerBudget() with a non-zero limit.
+		LayerFlags_Dropped    = 1 << 6, // Dropped by BudgetPolicy_DropLayer, in m_droppedLayers.
+	};
+
 	// Return -1 if _id not found.
 	int                 findLayerIndex(Id _id) const;
+	// As findLayerIndex() but add a new layer if _id not found.
+	U32                 findOrAddLayerIndex(Id _id);
+	// Free layers which weren't pushed for AppData::m_layerMaxUnusedFrames, call during reset().
+	void                collectLayers();
+	// Update m_layerRecording/m_layerRetained from m_layerFlags[m_layerIndex].
+	void                updateLayerState();
+	// If a layer with _flags accepts new primitives.
+	static bool         isLayerRecording(U32 _flags)     { return (_flags & (LayerFlags_Disabled | LayerFlags_Recorded)) == 0; }
+	// If a layer with _flags has retained data from an earlier frame which is hidden by setLayerEnabled(false).
+	static bool         isLayerHidden(U32 _flags)        { return (_flags & (LayerFlags_Disabled | LayerFlags_Recorded)) == (LayerFlags_Disabled | LayerFlags_Recorded); }
+	// Add _id -> _index to m_layerIdHash, call after pushing _id to m_layerIdMap.
+	void                insertLayerIndex(Id _id, U32 _index);
+
+	// Add list _list of m_vertexData[_sorted] to m_activeLists (if not already present), call before writing to the list.
+	void                markListActive(int _sorted, U32 _list);
+	// Add _layer to m_activeTextLayers (if not already present), call before writing to the layer's text list.
+	void                markTextActive(U32 _layer);
+	// Sort the active sets so that draw lists are generated in layer order.
+	void                sortActiveLists();
+
+	// Set m_primVertexBudget from the context/layer budgets, call during begin() if any budget applies.
+	void                updatePrimBudget();
+	// Drop the current primitive (+ _count vertices which weren't written), apply the budget policy.
+	void                dropPrimitive(U32 _count);
+	// Return false if _bytes of text don't fit in the context/layer budgets (and apply the policy).
+	bool                checkTextBudget(U32 _bytes);
+	// Discard the data recorded into _layer this frame, reject any more until reset().
+	void                dropLayer(U32 _layer);
+	// Keep the primitives nearest to the view origin which fit in _maxVertices, for _layer or all layers if -1.
+	void                keepNearest(int _layer, U32 _maxVertices);
+	// Return the # vertices (indices if IM3D_INDEXED_DRAW_LISTS) in all of _layer's lists.
+	U32                 getLayerVertexCount(U32 _layer) const;
+	// Allocate m_sortScratch on first use.
+	SortScratch&        getSortScratch();
 
 	// Access the current vertex/text data based on m_layerIndex.
 	VertexList*         getCurrentVertexList();
 	TextList*           getCurrentTextList();
+	#if IM3D_INDEXED_DRAW_LISTS
+	IndexList*          getCurrentIndexList();
+	#endif
 };
 
 namespace internal {
@@ -803,6 +1291,12 @@ inline U32                 GetDrawListCount()
 inline const TextDrawList* GetTextDrawLists()                                                                               { return GetContext().getTextDrawLists(); }
 inline U32                 GetTextDrawListCount()                                                                           { return GetContext().getTextDrawListCount(); }
 
+inline const DrawVertexData* GetFrameVertexData()                                                                           { return GetContext().getFrameVertexData(); }
+inline U32                 GetFrameVertexCount()                                                                            { return GetContext().getFrameVertexCount(); }
+inline const U32*          GetFrameIndexData()                                                                              { return GetContext().getFrameIndexData(); }
+inline U32                 GetFrameIndexCount()                                                                             { return GetContext().getFrameIndexCount(); }
+inline const FrameSnapshot* AcquireFrameSnapshot()                                                                          { return GetContext().acquireFrameSnapshot(); }
+
 inline void                BeginPoints()                                                                                    { GetContext().begin(PrimitiveMode_Points); }
 inline void                BeginLines()                                                                                     { GetContext().begin(PrimitiveMode_Lines); }
 inline void                BeginLineLoop()                                                                                  { GetContext().begin(PrimitiveMode_LineLoop); }
@@ -819,6 +1313,9 @@ inline void                Vertex(float _x, float _y, float _z)
 inline void                Vertex(float _x, float _y, float _z, Color _color)                                               { Vertex(Vec3(_x, _y, _z), _color); }
 inline void                Vertex(float _x, float _y, float _z, float _size)                                                { Vertex(Vec3(_x, _y, _z), _size); }
 inline void                Vertex(float _x, float _y, float _z, float _size, Color _color)                                  { Vertex(Vec3(_x, _y, _z), _size, _color); }
+inline void                Vertices(const Vec3* _positions, U32 _count)                                                     { GetContext().vertices(_positions, nullptr, nullptr, _count); }
+inline void                Vertices(const Vec3* _positions, const Color* _colors, U32 _count)                               { GetContext().vertices(_positions, nullptr, _colors, _count); }
+inline void                Vertices(const Vec3* _positions, const float* _sizes, const Color* _colors, U32 _count)          { GetContext().vertices(_positions, _sizes, _colors, _count); }
 
 inline void                PushDrawState()                                                                                  { Context& ctx = GetContext(); ctx.pushColor(ctx.getColor()); ctx.pushAlpha(ctx.getAlpha()); ctx.pushSize(ctx.getSize()); ctx.pushEnableSorting(ctx.getEnableSorting()); }
 inline void                PopDrawState()                                                                                   { Context& ctx = GetContext(); ctx.popColor(); ctx.popAlpha(); ctx.popSize(); ctx.popEnableSorting(); }
@@ -866,6 +1363,14 @@ inline void                PushLayerId(Id _layer)
 inline void                PushLayerId(const char* _str)                                                                    { PushLayerId(MakeId(_str)); }
 inline void                PopLayerId()                                                                                     { GetContext().popLayerId(); }
 inline Id                  GetLayerId()                                                                                     { return GetContext().getLayerId(); }
+inline void                SetLayerEnabled(Id _layer, bool _enable)                                                         { GetContext().setLayerEnabled(_layer, _enable); }
+inline bool                IsLayerEnabled(Id _layer)                                                                        { return GetContext().isLayerEnabled(_layer); }
+inline bool                IsLayerEnabled()                                                                                 { return GetContext().isLayerEnabled(); }
+inline void                SetLayerRetained(Id _layer, bool _retain)                                                        { GetContext().setLayerRetained(_layer, _retain); }
+inline void                InvalidateLayer(Id _layer)                                                                       { GetContext().invalidateLayer(_layer); }
+inline bool                IsLayerRecording()                                                                               { return GetContext().isLayerRecording(); }
+inline void                SetLayerBudget(Id _layer, const Budget& _budget)                                                 { GetContext().setLayerBudget(_layer, _budget); }
+inline const BudgetStats&  GetBudgetStats()                                                                                 { return GetContext().getBudgetStats(); }
 
 inline bool                GizmoTranslation(const char* _id, float _translation_[3], bool _local)                           { return GizmoTranslation(MakeId(_id), _translation_, _local);   }
 inline bool                GizmoRotation(const char* _id, float _rotation_[3*3], bool _local)                               { return GizmoRotation(MakeId(_id), _rotation_, _local);}
@@ -881,5 +1386,8 @@ inline bool                IsVisible(const Vec3& _min, const Vec3& _max)
 inline Context&            GetContext()                                                                                     { return *internal::g_CurrentContext; }
 inline void                SetContext(Context& _ctx)                                                                        { internal::g_CurrentContext = &_ctx; }
 inline void                MergeContexts(Context& _dst_, const Context& _src)                                               { _dst_.merge(_src); }
+inline void                MergeContexts(Context& _dst_, const Context* const* _srcs, U32 _count)                           { _dst_.merge(_srcs, _count); }
+inline void                PresortForMerge()                                                                                { GetContext().presortForMerge(); }
+inline const AllocStats&   GetAllocStats()                                                                                  { return GetContext().getAllocStats(); }
 
 } // namespac Im3d
@@ -7,6 +7,12 @@
 //#define IM3D_MALLOC(size) malloc(size)
 //#define IM3D_FREE(ptr) free(ptr)
 
+// Track allocations per context (GetAllocStats()) and assert if a context allocates after AppData::m_allocWarmupFrames.
+//#define IM3D_ALLOC_TRACKING 1
+
+// Back vertex lists with reserved virtual memory which is committed on demand (POSIX mmap), see AppData::m_vertexListReserve.
+//#define IM3D_VIRTUAL_MEMORY 1
+
 // User-defined API declaration (e.g. __declspec(dllexport)).
 //#define IM3D_API
 
@@ -19,6 +25,15 @@
 // Force vertex data alignment (default is 4 bytes).
 //#define IM3D_VERTEX_ALIGNMENT 4
 
+// Output indexed draw lists: vertices shared by strips/loops are stored once and DrawList::m_indexData references them (default is non-indexed).
+//#define IM3D_INDEXED_DRAW_LISTS 1
+
+// Output compact 16 byte vertices (VertexDataCompact) in draw lists; conversion happens once during EndFrame(). See examples/OpenGL33/im3d.glsl or examples/DirectX11/im3d.hlsl for how to decode.
+//#define IM3D_VERTEX_COMPACT 1
+
+// Use SIMD instructions (SSE2 on x86/x64, NEON on ARM) to transform vertices by the matrix stack. Falls back to scalar code if neither is available.
+//#define IM3D_SIMD 1
+
 // Enable internal culling for primitives (everything drawn between Begin*()/End()). The application must set a culling frustum via AppData.
 //#define IM3D_CULL_PRIMITIVES 1
 